@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -6,44 +7,44 @@
 #include <stdio.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
 
 #include "strip.h"
 #include "bytecode.h"
+#include "layout.h"
+#include "sync.h"
 
 #define ERROR(...) \
 	{ \
-		sError = true; \
-		sRunning = false; \
-		memset(sErrorBytecode.message, 0, sizeof(sErrorBytecode.message)); \
-		sprintf(sErrorBytecode.message, __VA_ARGS__); \
-		bc_update((uint8_t *) &sErrorBytecode, false); \
+		vm->error = true; \
+		vm->running = false; \
+		memset(vm->message, 0, sizeof(vm->message)); \
+		sprintf(vm->message, __VA_ARGS__); \
+		if (!vm->sandbox && !vm->inLayer) { \
+			bc_stage_error(vm->message); \
+		} \
 	}
 
-uint8_t gBytecode[BC_MAX_LEN];
+uint8_t *gBytecode;
 size_t gBytecodeLen;
+struct BytecodeStats gBytecodeStats;
+struct BytecodeBench gBytecodeBench;
 
-static uint8_t sInitBytecode[76] = {
-	/* checksum */ 0x00,
-	/* mode */ BC_MODE_PER_LED,
-	/* 02: hsv             */ 0x02,
-	/* 03: periodi 100.0f  */ 0x03, 0x42, 0xC8, 0x00, 0x00,
-	/* 08: vali 150.0f     */ 0x07, 0x43, 0x16, 0x00, 0x00,
-	/* 0D: getposend r0    */ 0x0C, 0x00,
-	/* 0F: getticks r1     */ 0x0D, 0x01,
-	/* 11: addr r0 r0 r1   */ 0x13, 0x00, 0x00, 0x01,
-	/* 15: divi r0 r0 3.0f */ 0x17, 0x00, 0x00, 0x40, 0x40, 0x00, 0x00,
-	/* 1C: modi r0 r0 4.0f */ 0x19, 0x00, 0x00, 0x40, 0x80, 0x00, 0x00,
-	/* 23: cz r0           */ 0x41, 0x00,
-	/* 25: haltt           */ 0x33,
-	/* 26: huei 348.0f     */ 0x05, 0x43, 0xAE, 0x00, 0x00,
-	/* 2B: sati 79.0f      */ 0x06, 0x42, 0x9E, 0x00, 0x00,
-	/* 30: modi r1 r0 2.0f */ 0x19, 0x01, 0x00, 0x40, 0x00, 0x00, 0x00,
-	/* 37: cnz r1          */ 0x42, 0x01,
-	/* 39: haltt           */ 0x33,
-	/* 3A: huei 197.0f     */ 0x05, 0x43, 0x45, 0x00, 0x00,
-	/* 3F: sati 162.0f     */ 0x06, 0x43, 0x22, 0x00, 0x00,
-	/* end */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+#define EFFECT(name, ...) static uint8_t sEffect_ ## name[] = { __VA_ARGS__ };
+#include "effects.h"
+#undef EFFECT
+
+#define EFFECT(name, ...) { #name, sEffect_ ## name, sizeof(sEffect_ ## name) },
+const struct BytecodeEffect gBytecodeEffects[BC_EFFECT_COUNT] = {
+#include "effects.h"
 };
+#undef EFFECT
 
 static struct ErrorBytecode sErrorBytecode = {
 	.mode = BC_MODE_PER_LED,
@@ -58,722 +59,3497 @@ static struct ErrorBytecode sErrorBytecode = {
 	.end = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }
 };
 
+static void bc_stage_error(const char *message);
+
+static const uint8_t sNoisePerm[256] = {
+	0x97, 0xA0, 0x89, 0x5B, 0x5A, 0x0F, 0x83, 0x0D, 0xC9, 0x5F, 0x60, 0x35, 0xC2, 0xE9, 0x07, 0xE1,
+	0x8C, 0x24, 0x67, 0x1E, 0x45, 0x8E, 0x08, 0x63, 0x25, 0xF0, 0x15, 0x0A, 0x17, 0xBE, 0x06, 0x94,
+	0xF7, 0x78, 0xEA, 0x4B, 0x00, 0x1A, 0xC5, 0x3E, 0x5E, 0xFC, 0xDB, 0xCB, 0x75, 0x23, 0x0B, 0x20,
+	0x39, 0xB1, 0x21, 0x58, 0xED, 0x95, 0x38, 0x57, 0xAE, 0x14, 0x7D, 0x88, 0xAB, 0xA8, 0x44, 0xAF,
+	0x4A, 0xA5, 0x47, 0x86, 0x8B, 0x30, 0x1B, 0xA6, 0x4D, 0x92, 0x9E, 0xE7, 0x53, 0x6F, 0xE5, 0x7A,
+	0x3C, 0xD3, 0x85, 0xE6, 0xDC, 0x69, 0x5C, 0x29, 0x37, 0x2E, 0xF5, 0x28, 0xF4, 0x66, 0x8F, 0x36,
+	0x41, 0x19, 0x3F, 0xA1, 0x01, 0xD8, 0x50, 0x49, 0xD1, 0x4C, 0x84, 0xBB, 0xD0, 0x59, 0x12, 0xA9,
+	0xC8, 0xC4, 0x87, 0x82, 0x74, 0xBC, 0x9F, 0x56, 0xA4, 0x64, 0x6D, 0xC6, 0xAD, 0xBA, 0x03, 0x40,
+	0x34, 0xD9, 0xE2, 0xFA, 0x7C, 0x7B, 0x05, 0xCA, 0x26, 0x93, 0x76, 0x7E, 0xFF, 0x52, 0x55, 0xD4,
+	0xCF, 0xCE, 0x3B, 0xE3, 0x2F, 0x10, 0x3A, 0x11, 0xB6, 0xBD, 0x1C, 0x2A, 0xDF, 0xB7, 0xAA, 0xD5,
+	0x77, 0xF8, 0x98, 0x02, 0x2C, 0x9A, 0xA3, 0x46, 0xDD, 0x99, 0x65, 0x9B, 0xA7, 0x2B, 0xAC, 0x09,
+	0x81, 0x16, 0x27, 0xFD, 0x13, 0x62, 0x6C, 0x6E, 0x4F, 0x71, 0xE0, 0xE8, 0xB2, 0xB9, 0x70, 0x68,
+	0xDA, 0xF6, 0x61, 0xE4, 0xFB, 0x22, 0xF2, 0xC1, 0xEE, 0xD2, 0x90, 0x0C, 0xBF, 0xB3, 0xA2, 0xF1,
+	0x51, 0x33, 0x91, 0xEB, 0xF9, 0x0E, 0xEF, 0x6B, 0x31, 0xC0, 0xD6, 0x1F, 0xB5, 0xC7, 0x6A, 0x9D,
+	0xB8, 0x54, 0xCC, 0xB0, 0x73, 0x79, 0x32, 0x2D, 0x7F, 0x04, 0x96, 0xFE, 0x8A, 0xEC, 0xCD, 0x5D,
+	0xDE, 0x72, 0x43, 0x1D, 0x18, 0x48, 0xF3, 0x8D, 0x80, 0xC3, 0x4E, 0x42, 0xD7, 0x3D, 0x9C, 0xB4
+};
+
+static float sSinTable[BC_SIN_TABLE_SIZE + 1];
+
 static TaskHandle_t sBytecodeTask;
 
-// Settings
-static uint32_t sTicks;
-static uint32_t sPeriodMs;
+// Program areas, one active and one being loaded. The error program runs
+// from sErrorBytecode itself.
+static uint8_t sBytecodeAreas[2][BC_MAX_LEN];
+static size_t sActiveArea;
+static uint8_t *sPendingBytecode;
+static size_t sPendingLen;
+static uint32_t sPendingHash;
+static bool sPending;
+static int64_t sPendingAt;
+static SemaphoreHandle_t sUpdateLock;
+
+// Where bc_scan is in a program, so one arriving in pieces can be decoded as
+// it comes in
+struct ScanState {
+	size_t pc;
+	size_t len;
+	uint32_t regs[256 / 32];
+	uint32_t intRegs[256 / 32];
+	uint32_t cost;
+	uint32_t maxTarget;
+	size_t maxTargetAt;
+};
+
+// Upload being streamed in, see bc_stream_begin. sStreamBuffer is only set
+// when it didn't go straight into the inactive area. A program update
+// staged there meanwhile aborts it.
+static bool sStreaming;
+static bool sStreamAborted;
+static uint8_t *sStreamArea;
+static uint8_t *sStreamBuffer;
+static size_t sStreamMax;
+static size_t sStreamReceived;
+static size_t sStreamLen;
+static size_t sStreamMarker;
+static uint8_t sStreamCrc;
+static uint32_t sStreamHash;
+static struct ScanState sStreamScan;
+static struct BytecodeAnalysis *sStreamAnalysis;
+
+// Everything a running program sees and changes. The active program and its
+// layers run in sVm, while sandboxed runs get one of their own, so they can
+// run alongside it.
+struct BytecodeVm {
+	// The program, and its native translation if it's a stock effect
+	uint8_t *bytecode;
+	size_t len;
+	void (*native)(struct BytecodeVm *vm);
+	size_t pc;
+
+	// Tracking
+	uint32_t instrs;
+	uint32_t frameInstrs;
+	bool error;
+	bool running;
+	volatile bool cancel;
+	bool impure;
+	char message[256];
+
+	// Where the program renders to
+	uint32_t (*strip)[3];
+	enum StripMode *stripMode;
+	bool *stripInterpolate;
+	struct BytecodeStats *stats;
+
+	// The LEDs the program sees as its strip. Positions are relative to
+	// ledStart, everything else (layout, LED state) uses the real LED.
+	size_t ledStart;
+	size_t ledCount;
+	size_t curLed;
+	bool compare;
+	uint32_t rng;
+
+	// Settings
+	uint32_t ticks;
+	uint32_t periodMs;
+	size_t subsampleStep;
+	uint32_t subsampleThreshold;
+	uint32_t tickPeriod;
+
+	// Frame cache for periodic programs, one packed frame per tick of the
+	// period
+	uint32_t cachePeriod;
+	uint8_t (*cacheFrames)[STRIP_LED_COUNT][3];
+	uint8_t *cacheFlags;
+
+	// Whether the frame being rendered streams out to the strip as it goes,
+	// and whether the program has ruled that out by writing LEDs out of order
+	bool pipelined;
+	bool pipelineOff;
+
+	// Neither layers nor sandboxed runs stage the error program or get a
+	// frame cache, and sandboxed runs also stop at their deadline
+	bool inLayer;
+	bool sandbox;
+	int64_t deadline;
+
+	// Program state
+	float registers[256];
+	int32_t intRegisters[256];
+	float memory[BC_MEMORY_SIZE];
+	float ledState[BC_LED_STATE_SLOTS][STRIP_LED_COUNT];
+	uint16_t palettes[BC_PALETTE_COUNT][BC_PALETTE_SIZE][3];
+	uint32_t prevStrip[STRIP_LED_COUNT][3];
+};
 
-// Tracking
-static uint32_t sInstrs;
-static bool sError;
-static bool sRunning;
+static struct BytecodeVm sVm = {
+	.strip = gStripData,
+	.stripMode = &gStripMode,
+	.stripInterpolate = &gStripInterpolate,
+	.stats = &gBytecodeStats,
+	.ledCount = STRIP_LED_COUNT
+};
 
-// Program state
-static float sRegisters[256];
-static float sMemory[BC_MEMORY_SIZE];
-static bool sCompare;
-static size_t sCurLed;
-static uint32_t sRng;
-static size_t sPc;
+// Frame schedule in shared time, only followed when synced with other
+// controllers, see sync.c
+static struct SyncAnchor sAnchor;
+static esp_timer_handle_t sWakeTimer;
+
+// Layers, each a program rendered over its own LED range after the active
+// one and blended on top of it, see bc_layers_render. Like the active
+// program, each has a second area that updates are staged in.
+struct LayerSettings {
+	uint32_t ticks;
+	uint32_t periodMs;
+	size_t subsampleStep;
+	uint32_t subsampleThreshold;
+	uint32_t tickPeriod;
+};
 
-static inline float bc_read_mem(size_t idx) {
+static uint8_t sLayerAreas[BC_MAX_LAYERS][2][BC_LAYER_MAX_LEN];
+static size_t sLayerActiveArea[BC_MAX_LAYERS];
+static struct BytecodeLayer sLayers[BC_MAX_LAYERS];
+static struct BytecodeLayer sPendingLayers[BC_MAX_LAYERS];
+static bool sLayerPending[BC_MAX_LAYERS];
+static struct LayerSettings sLayerSettings[BC_MAX_LAYERS];
+static uint8_t sComposite[STRIP_LED_COUNT][3];
+static uint8_t sLayerFrame[STRIP_LED_COUNT][3];
+static uint32_t sLayerSaved[STRIP_LED_COUNT][3];
+static void (*sLayerNatives[BC_MAX_LAYERS])(struct BytecodeVm *vm);
+
+// Jobs run on the sandbox task, on the core the active program doesn't
+// render on, see bc_analyze and bc_bench
+static TaskHandle_t sSandboxTask;
+static void (*volatile sSandboxJob)(void);
+static SemaphoreHandle_t sSandboxDone;
+static struct BytecodeAnalysis *sTrialAnalysis;
+static uint8_t *sTrialBytecode;
+
+static uint8_t sBenchBytecode[BC_BENCH_BYTECODE_LEN];
+static volatile uint32_t sBenchSink;
+
+static inline float bc_read_mem(struct BytecodeVm *vm, size_t idx) {
 	if (idx >= BC_MEMORY_SIZE) {
 		ERROR("out of bounds memory read (addr %03x)", idx);
 		return 0.0f;
 	}
 
-	return sMemory[idx];
+	return vm->memory[idx];
 }
 
-static inline void bc_write_mem(size_t idx, float val) {
+static inline void bc_write_mem(struct BytecodeVm *vm, size_t idx, float val) {
+	vm->impure = true;
+
 	if (idx >= BC_MEMORY_SIZE) {
 		ERROR("out of bounds memory write (addr %04x)", idx);
 		return;
 	}
 
-	sMemory[idx] = val;
+	vm->memory[idx] = val;
+}
+
+static inline float *bc_led_state(struct BytecodeVm *vm, size_t slot) {
+	if (slot >= BC_LED_STATE_SLOTS) {
+		ERROR("led state slot out of range (%d)", slot);
+		return NULL;
+	}
+
+	return &vm->ledState[slot][vm->curLed];
 }
 
-static inline void bc_set_cur_led(size_t pos) {
-	if (pos >= STRIP_LED_COUNT) {
+static inline void bc_pipeline_stop(struct BytecodeVm *vm) {
+	if (vm->pipelined) {
+		vm->pipelined = false;
+		vm->pipelineOff = true;
+		strip_stream_drop();
+	}
+}
+
+static inline void bc_set_cur_led(struct BytecodeVm *vm, size_t pos) {
+	bc_pipeline_stop(vm);
+
+	if (pos >= vm->ledCount) {
 		ERROR("tried to set led outside the strip (position %d)", pos);
 		return;
 	}
 
-	sCurLed = pos;
+	vm->curLed = vm->ledStart + pos;
+}
+
+static inline bool bc_check_range(struct BytecodeVm *vm, size_t start, size_t count) {
+	bc_pipeline_stop(vm);
+
+	if (start > vm->ledCount || count > vm->ledCount - start) {
+		ERROR("led range outside the strip (position %d, count %d)", start, count);
+		return false;
+	}
+
+	return true;
+}
+
+// Programs that declare a period only ever see the tick within it, so as long
+// as they don't touch any state their frames repeat exactly every period
+static inline uint32_t bc_ticks(struct BytecodeVm *vm) {
+	return vm->tickPeriod != 0 ? vm->ticks % vm->tickPeriod : vm->ticks;
 }
 
-static inline uint8_t bc_next_u8(void) {
-	return gBytecode[sPc++];
+// Sandboxed runs also stop once they're over their time budget
+static inline bool bc_stopped(struct BytecodeVm *vm) {
+	return vm->cancel || (vm->sandbox && esp_timer_get_time() > vm->deadline);
 }
 
-static inline uint32_t bc_next_u32(void) {
-	uint32_t n = gBytecode[sPc++];
+static inline uint8_t bc_next_u8(struct BytecodeVm *vm) {
+	return vm->bytecode[vm->pc++];
+}
+
+static inline uint32_t bc_next_u32(struct BytecodeVm *vm) {
+	uint32_t n = vm->bytecode[vm->pc++];
 	n <<= 8;
-	n |= gBytecode[sPc++];
+	n |= vm->bytecode[vm->pc++];
 	n <<= 8;
-	n |= gBytecode[sPc++];
+	n |= vm->bytecode[vm->pc++];
 	n <<= 8;
-	n |= gBytecode[sPc++];
+	n |= vm->bytecode[vm->pc++];
 
 	return n;
 }
 
-static inline float bc_next_f32(void) {
+static inline uint32_t bc_load_u32(const uint8_t *bytes) {
+	return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+static inline void bc_store_u32(uint8_t *bytes, uint32_t n) {
+	bytes[0] = n >> 24;
+	bytes[1] = n >> 16;
+	bytes[2] = n >> 8;
+	bytes[3] = n;
+}
+
+static inline int32_t bc_next_i32(struct BytecodeVm *vm) {
+	return (int32_t) bc_next_u32(vm);
+}
+
+static inline float bc_next_f32(struct BytecodeVm *vm) {
 	union {
 		uint32_t i;
 		float f;
-	} cast = { .i = bc_next_u32() };
+	} cast = { .i = bc_next_u32(vm) };
 
 	return cast.f;
 }
 
+// INT32_MIN / -1 is the one quotient that doesn't fit, so -1 is handled as a
+// wrapping negation
+static inline int32_t bc_int_div(int32_t a, int32_t b) {
+	return b == -1 ? (int32_t) (0U - (uint32_t) a) : a / b;
+}
+
+static inline int32_t bc_int_mod(int32_t a, int32_t b) {
+	return b == -1 ? 0 : a % b;
+}
+
+static inline int32_t bc_int_rem(int32_t a, int32_t b) {
+	int32_t mod = bc_int_mod(a, b);
+	return mod != 0 && (mod < 0) != (b < 0) ? mod + b : mod;
+}
+
 /* Nop instruction */
 
-static void bc_op_nop(void) {}
+static void bc_op_nop(struct BytecodeVm *vm) {}
 
 /* Configuration instructions */
 
-static void bc_op_rgb(void) {
-	gStripMode = STRIP_MODE_RGB;
+static void bc_op_rgb(struct BytecodeVm *vm) {
+	*vm->stripMode = STRIP_MODE_RGB;
 }
 
-static void bc_op_hsv(void) {
-	gStripMode = STRIP_MODE_HSV;
+static void bc_op_hsv(struct BytecodeVm *vm) {
+	*vm->stripMode = STRIP_MODE_HSV;
 }
 
-static void bc_op_periodi(void) {
-	float imm = bc_next_f32();
-	sPeriodMs = (uint32_t) imm;
+static void bc_op_periodi(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	vm->periodMs = (uint32_t) imm;
 }
 
-static void bc_op_periodr(void) {
-	uint8_t reg = bc_next_u8();
-	sPeriodMs = (uint32_t) sRegisters[reg];
+static void bc_op_periodr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->periodMs = (uint32_t) vm->registers[reg];
 }
 
-static void bc_op_redi(void) {
-	float imm = bc_next_f32();
-	gStripData[sCurLed][0] = (uint32_t) imm;
+static void bc_op_redi(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	vm->strip[vm->curLed][0] = (uint32_t) imm;
 }
 
-static void bc_op_greeni(void) {
-	float imm = bc_next_f32();
-	gStripData[sCurLed][1] = (uint32_t) imm;
+static void bc_op_greeni(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	vm->strip[vm->curLed][1] = (uint32_t) imm;
 }
 
-static void bc_op_bluei(void) {
-	float imm = bc_next_f32();
-	gStripData[sCurLed][2] = (uint32_t) imm;
+static void bc_op_bluei(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	vm->strip[vm->curLed][2] = (uint32_t) imm;
 }
 
-static void bc_op_redr(void) {
-	uint8_t reg = bc_next_u8();
-	gStripData[sCurLed][0] = (uint32_t) sRegisters[reg];
+static void bc_op_redr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][0] = (uint32_t) vm->registers[reg];
 }
 
-static void bc_op_greenr(void) {
-	uint8_t reg = bc_next_u8();
-	gStripData[sCurLed][1] = (uint32_t) sRegisters[reg];
+static void bc_op_greenr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][1] = (uint32_t) vm->registers[reg];
 }
 
-static void bc_op_bluer(void) {
-	uint8_t reg = bc_next_u8();
-	gStripData[sCurLed][2] = (uint32_t) sRegisters[reg];
+static void bc_op_bluer(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][2] = (uint32_t) vm->registers[reg];
 }
 
-static void bc_op_getpos(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = (float) sCurLed;
+static void bc_op_getpos(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = (float) (vm->curLed - vm->ledStart);
 }
 
-static void bc_op_getposend(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = (float) (STRIP_LED_COUNT - sCurLed);
+static void bc_op_getposend(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = (float) (vm->ledStart + vm->ledCount - vm->curLed);
 }
 
-static void bc_op_getticks(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = (float) sTicks;
+static void bc_op_getticks(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = (float) bc_ticks(vm);
 }
 
-static void bc_op_getrng(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = (float) sRng / 0xFFFFFFFFU;
+static void bc_op_getrng(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->impure = true;
+	vm->registers[reg] = (float) vm->rng / 0xFFFFFFFFU;
 }
 
-static void bc_op_getnumleds(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = STRIP_LED_COUNT;
+static void bc_op_getnumleds(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = vm->ledCount;
 }
 
 /* Arithmetic instructions */
 
-static void bc_op_movi(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg] = imm;
+static void bc_op_movi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg] = imm;
 }
 
-static void bc_op_movr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1];
+static void bc_op_movr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1];
 }
 
-static void bc_op_addi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg0] = sRegisters[reg1] + imm;
+static void bc_op_addi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg0] = vm->registers[reg1] + imm;
 }
 
-static void bc_op_addr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] + sRegisters[reg2];
+static void bc_op_addr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1] + vm->registers[reg2];
 }
 
-static void bc_op_subr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] - sRegisters[reg2];
+static void bc_op_subr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1] - vm->registers[reg2];
 }
 
-static void bc_op_muli(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg0] = sRegisters[reg1] * imm;
+static void bc_op_muli(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg0] = vm->registers[reg1] * imm;
 }
 
-static void bc_op_mulr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] * sRegisters[reg2];
+static void bc_op_mulr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1] * vm->registers[reg2];
 }
 
-static void bc_op_divi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
+static void bc_op_divi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
 
 	if (imm == 0.0f) {
 		ERROR("divi by zero");
 	} else {
-		sRegisters[reg0] = sRegisters[reg1] / imm;
+		vm->registers[reg0] = vm->registers[reg1] / imm;
 	}
 }
 
-static void bc_op_divr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
+static void bc_op_divr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
 
-	if (sRegisters[reg2] == 0.0f) {
+	if (vm->registers[reg2] == 0.0f) {
 		ERROR("divr by zero");
 	} else {
-		sRegisters[reg0] = sRegisters[reg1] / sRegisters[reg2];
+		vm->registers[reg0] = vm->registers[reg1] / vm->registers[reg2];
 	}
 }
 
-static void bc_op_modi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
+static void bc_op_modi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
 
 	int32_t div = (int32_t) imm;
 	if (div == 0) {
 		ERROR("modi by zero");
 	} else {
-		sRegisters[reg0] = (float) ((int32_t) sRegisters[reg1] % div);
+		vm->registers[reg0] = (float) ((int32_t) vm->registers[reg1] % div);
 	}
 }
 
-static void bc_op_modr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
+static void bc_op_modr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
 
-	int32_t div = (int32_t) sRegisters[reg2];
+	int32_t div = (int32_t) vm->registers[reg2];
 	if (div == 0) {
 		ERROR("modr by zero");
 	} else {
-		sRegisters[reg0] = (float) ((int32_t) sRegisters[reg1] % div);
+		vm->registers[reg0] = (float) ((int32_t) vm->registers[reg1] % div);
 	}
 }
 
-static void bc_op_remi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
+static void bc_op_remi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
 
 	int32_t div = (int32_t) imm;
 	if (div == 0) {
 		ERROR("remi by zero");
 	} else {
-		sRegisters[reg0] = (float) (((int32_t) sRegisters[reg1] % div + div) % div);
+		vm->registers[reg0] = (float) (((int32_t) vm->registers[reg1] % div + div) % div);
 	}
 }
 
-static void bc_op_remr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
+static void bc_op_remr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
 
-	int32_t div = (int32_t) sRegisters[reg2];
+	int32_t div = (int32_t) vm->registers[reg2];
 	if (div == 0) {
 		ERROR("remr by zero");
 	} else {
-		sRegisters[reg0] = (float) (((int32_t) sRegisters[reg1] % div + div) % div);
+		vm->registers[reg0] = (float) (((int32_t) vm->registers[reg1] % div + div) % div);
 	}
 }
 
-static void bc_op_sinr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = sinf(sRegisters[reg1]);
+static void bc_op_sinr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = sinf(vm->registers[reg1]);
 }
 
-static void bc_op_cosr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = cosf(sRegisters[reg1]);
+static void bc_op_cosr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = cosf(vm->registers[reg1]);
 }
 
-static void bc_op_tanr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = tanf(sRegisters[reg1]);
+static void bc_op_tanr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = tanf(vm->registers[reg1]);
 }
 
-static void bc_op_asinr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = asinf(sRegisters[reg1]);
+static void bc_op_asinr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = asinf(vm->registers[reg1]);
 }
 
-static void bc_op_acosr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = acosf(sRegisters[reg1]);
+static void bc_op_acosr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = acosf(vm->registers[reg1]);
 }
 
-static void bc_op_atanr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = atanf(sRegisters[reg1]);
+static void bc_op_atanr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = atanf(vm->registers[reg1]);
 }
 
-static void bc_op_atan2r(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = atan2f(sRegisters[reg1], sRegisters[reg2]);
+static void bc_op_atan2r(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = atan2f(vm->registers[reg1], vm->registers[reg2]);
 }
 
-static void bc_op_sqrtr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = sqrtf(sRegisters[reg1]);
+static void bc_op_sqrtr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = sqrtf(vm->registers[reg1]);
 }
 
-static void bc_op_floorr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = floorf(sRegisters[reg1]);
+static void bc_op_floorr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = floorf(vm->registers[reg1]);
 }
 
-static void bc_op_ceilr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = ceilf(sRegisters[reg1]);
+static void bc_op_ceilr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = ceilf(vm->registers[reg1]);
 }
 
-static void bc_op_roundr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = roundf(sRegisters[reg1]);
+static void bc_op_roundr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = roundf(vm->registers[reg1]);
 }
 
-static void bc_op_mini(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg0] = sRegisters[reg1] < imm ? sRegisters[reg1] : imm;
+static void bc_op_mini(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg0] = vm->registers[reg1] < imm ? vm->registers[reg1] : imm;
 }
 
-static void bc_op_minr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] < sRegisters[reg2] ? sRegisters[reg1] : sRegisters[reg2];
+static void bc_op_minr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1] < vm->registers[reg2] ? vm->registers[reg1] : vm->registers[reg2];
 }
 
-static void bc_op_maxi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg0] = sRegisters[reg1] > imm ? sRegisters[reg1] : imm;
+static void bc_op_maxi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg0] = vm->registers[reg1] > imm ? vm->registers[reg1] : imm;
 }
 
-static void bc_op_maxr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	uint8_t reg2 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] > sRegisters[reg2] ? sRegisters[reg1] : sRegisters[reg2];
+static void bc_op_maxr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = vm->registers[reg1] > vm->registers[reg2] ? vm->registers[reg1] : vm->registers[reg2];
 }
 
-static void bc_op_clampi(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	float imm0 = bc_next_f32();
-	float imm1 = bc_next_f32();
-	sRegisters[reg0] = sRegisters[reg1] < imm0 ? imm0 : sRegisters[reg1] > imm1 ? imm1 : sRegisters[reg1];
+static void bc_op_clampi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm0 = bc_next_f32(vm);
+	float imm1 = bc_next_f32(vm);
+	vm->registers[reg0] = vm->registers[reg1] < imm0 ? imm0 : vm->registers[reg1] > imm1 ? imm1 : vm->registers[reg1];
 }
 
-static void bc_op_absr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = sRegisters[reg1] < 0 ? -sRegisters[reg1] : sRegisters[1];
+static void bc_op_absr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = fabsf(vm->registers[reg1]);
 }
 
 /* Control flow instructions */
 
-static void bc_op_goto(void) {
-	uint32_t dest = bc_next_u32();
-	sPc = dest;
+static void bc_op_goto(struct BytecodeVm *vm) {
+	uint32_t dest = bc_next_u32(vm);
+	vm->pc = dest;
 }
 
-static void bc_op_jt(void) {
-	uint32_t dest = bc_next_u32();
-	if (sCompare) {
-		sPc = dest;
+static void bc_op_jt(struct BytecodeVm *vm) {
+	uint32_t dest = bc_next_u32(vm);
+	if (vm->compare) {
+		vm->pc = dest;
 	}
 }
 
-static void bc_op_jf(void) {
-	uint32_t dest = bc_next_u32();
-	if (!sCompare) {
-		sPc = dest;
+static void bc_op_jf(struct BytecodeVm *vm) {
+	uint32_t dest = bc_next_u32(vm);
+	if (!vm->compare) {
+		vm->pc = dest;
 	}
 }
 
-static void bc_op_haltt(void) {
-	if (sCompare) {
-		sRunning = false;
+static void bc_op_haltt(struct BytecodeVm *vm) {
+	if (vm->compare) {
+		vm->running = false;
 	}
 }
 
-static void bc_op_haltf(void) {
-	if (!sCompare) {
-		sRunning = false;
+static void bc_op_haltf(struct BytecodeVm *vm) {
+	if (!vm->compare) {
+		vm->running = false;
 	}
 }
 
 /* Comparison instructions */
 
-static void bc_op_getcmp(void) {
-	uint8_t reg = bc_next_u8();
-	sRegisters[reg] = (float) sCompare;
+static void bc_op_getcmp(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = (float) vm->compare;
 }
 
-static void bc_op_cz(void) {
-	uint8_t reg = bc_next_u8();
-	sCompare = sRegisters[reg] == 0.0f;
+static void bc_op_cz(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->compare = vm->registers[reg] == 0.0f;
 }
 
-static void bc_op_cnz(void) {
-	uint8_t reg = bc_next_u8();
-	sCompare = sRegisters[reg] != 0.0f;
+static void bc_op_cnz(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->compare = vm->registers[reg] != 0.0f;
 }
 
-static void bc_op_ceqi(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sCompare = sRegisters[reg] == imm;
+static void bc_op_ceqi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->compare = vm->registers[reg] == imm;
 }
 
-static void bc_op_ceqr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sCompare = sRegisters[reg0] == sRegisters[reg1];
+static void bc_op_ceqr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->registers[reg0] == vm->registers[reg1];
 }
 
-static void bc_op_clti(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sCompare = sRegisters[reg] < imm;
+static void bc_op_clti(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->compare = vm->registers[reg] < imm;
 }
 
-static void bc_op_cltr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sCompare = sRegisters[reg0] < sRegisters[reg1];
+static void bc_op_cltr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->registers[reg0] < vm->registers[reg1];
 }
 
-static void bc_op_clei(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sCompare = sRegisters[reg] <= imm;
+static void bc_op_clei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->compare = vm->registers[reg] <= imm;
 }
 
-static void bc_op_cler(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sCompare = sRegisters[reg0] <= sRegisters[reg1];
+static void bc_op_cler(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->registers[reg0] <= vm->registers[reg1];
 }
 
-static void bc_op_cgti(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sCompare = sRegisters[reg] > imm;
+static void bc_op_cgti(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->compare = vm->registers[reg] > imm;
 }
 
-static void bc_op_cgtr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sCompare = sRegisters[reg0] > sRegisters[reg1];
+static void bc_op_cgtr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->registers[reg0] > vm->registers[reg1];
 }
 
-static void bc_op_cgei(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sCompare = sRegisters[reg] >= imm;
+static void bc_op_cgei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->compare = vm->registers[reg] >= imm;
 }
 
-static void bc_op_cger(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sCompare = sRegisters[reg0] >= sRegisters[reg1];
+static void bc_op_cger(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->registers[reg0] >= vm->registers[reg1];
 }
 
 /* Memory instructions */
 
-static void bc_op_loadi(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	sRegisters[reg] = bc_read_mem((size_t) imm);
+static void bc_op_loadi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->registers[reg] = bc_read_mem(vm, (size_t) imm);
 }
 
-static void bc_op_loadr(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	sRegisters[reg0] = bc_read_mem((size_t) sRegisters[reg1]);
+static void bc_op_loadr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_read_mem(vm, (size_t) vm->registers[reg1]);
 }
 
-static void bc_op_storei(void) {
-	uint8_t reg = bc_next_u8();
-	float imm = bc_next_f32();
-	bc_write_mem((size_t) imm, sRegisters[reg]);
+static void bc_op_storei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	bc_write_mem(vm, (size_t) imm, vm->registers[reg]);
 }
 
-static void bc_op_storer(void) {
-	uint8_t reg0 = bc_next_u8();
-	uint8_t reg1 = bc_next_u8();
-	bc_write_mem((size_t) sRegisters[reg1], sRegisters[reg0]);
+static void bc_op_storer(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	bc_write_mem(vm, (size_t) vm->registers[reg1], vm->registers[reg0]);
 }
 
-/* Configuration instructions 2 */
+/* LED state instructions */
+
+static void bc_op_sloadi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
 
-static void bc_op_posi(void) {
-	float imm = bc_next_f32();
-	bc_set_cur_led((size_t) imm);
+	float *state = bc_led_state(vm, (size_t) imm);
+	if (state != NULL) {
+		vm->registers[reg] = *state;
+	}
 }
 
-static void bc_op_posr(void) {
-	uint8_t reg = bc_next_u8();
-	bc_set_cur_led((size_t) sRegisters[reg]);
+static void bc_op_sloadr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+
+	float *state = bc_led_state(vm, (size_t) vm->registers[reg1]);
+	if (state != NULL) {
+		vm->registers[reg0] = *state;
+	}
 }
 
-static void bc_op_posendi(void) {
-	float imm = bc_next_f32();
-	bc_set_cur_led(STRIP_LED_COUNT - (size_t) imm);
+static void bc_op_sstorei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	vm->impure = true;
+
+	float *state = bc_led_state(vm, (size_t) imm);
+	if (state != NULL) {
+		*state = vm->registers[reg];
+	}
 }
 
-static void bc_op_posendr(void) {
-	uint8_t reg = bc_next_u8();
-	bc_set_cur_led(STRIP_LED_COUNT - (size_t) sRegisters[reg]);
+static void bc_op_sstorer(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->impure = true;
+
+	float *state = bc_led_state(vm, (size_t) vm->registers[reg1]);
+	if (state != NULL) {
+		*state = vm->registers[reg0];
+	}
 }
 
-/* Halt instruction */
+/* Noise instructions */
 
-static void bc_op_halt(void) {
-	sRunning = false;
+// Gradient noise is evaluated in fixed point with BC_NOISE_FRAC_BITS of
+// fraction, so the same program renders identically on the host and device.
+// Results are roughly in [-1, 1].
+
+#define NOISE_ONE (1 << BC_NOISE_FRAC_BITS)
+
+static inline void bc_noise_split(float v, int32_t *cell, int32_t *frac) {
+	float f = floorf(v);
+	*cell = (int32_t) f;
+	*frac = (int32_t) ((v - f) * NOISE_ONE);
 }
 
-#define OP(opcode, func) bc_op_ ## func,
-#define OP_ALIAS(opcode, func)
-#define OP_NONE(opcode) NULL,
+static inline int32_t bc_noise_fade(int32_t t) {
+	int32_t t3 = (((t * t) >> BC_NOISE_FRAC_BITS) * t) >> BC_NOISE_FRAC_BITS;
+	int32_t inner = ((t * (6 * t - 15 * NOISE_ONE)) >> BC_NOISE_FRAC_BITS) + 10 * NOISE_ONE;
+	return (t3 * inner) >> BC_NOISE_FRAC_BITS;
+}
 
-static void (*sOps[256])(void) = {
-#include "files/ops.h"
-};
+static inline int32_t bc_noise_lerp(int32_t a, int32_t b, int32_t t) {
+	return a + (((b - a) * t) >> BC_NOISE_FRAC_BITS);
+}
 
-#undef OP
-#undef OP_NONE
+static inline uint8_t bc_noise_hash(int32_t x) {
+	return sNoisePerm[x & 0xFF];
+}
 
-static void bc_update_rng(void) {
-	if (sRng == 1) {
-		sRng = 0;
-		return;
-	}
+static inline int32_t bc_noise_grad1(uint8_t h, int32_t x) {
+	return h & 1 ? -2 * x : 2 * x;
+}
+
+static inline int32_t bc_noise_grad2(uint8_t h, int32_t x, int32_t y) {
+	return (h & 1 ? -x : x) + (h & 2 ? -y : y);
+}
+
+static inline int32_t bc_noise_grad3(uint8_t h, int32_t x, int32_t y, int32_t z) {
+	h &= 15;
+	int32_t u = h < 8 ? x : y;
+	int32_t v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+	return (h & 1 ? -u : u) + (h & 2 ? -v : v);
+}
+
+static int32_t bc_noise1(float x) {
+	int32_t xi, xf;
+	bc_noise_split(x, &xi, &xf);
+
+	return bc_noise_lerp(
+		bc_noise_grad1(bc_noise_hash(xi), xf),
+		bc_noise_grad1(bc_noise_hash(xi + 1), xf - NOISE_ONE),
+		bc_noise_fade(xf));
+}
+
+static int32_t bc_noise2(float x, float y) {
+	int32_t xi, xf, yi, yf;
+	bc_noise_split(x, &xi, &xf);
+	bc_noise_split(y, &yi, &yf);
+
+	uint8_t a = bc_noise_hash(xi);
+	uint8_t b = bc_noise_hash(xi + 1);
+	int32_t u = bc_noise_fade(xf);
+
+	int32_t n0 = bc_noise_lerp(
+		bc_noise_grad2(bc_noise_hash(a + yi), xf, yf),
+		bc_noise_grad2(bc_noise_hash(b + yi), xf - NOISE_ONE, yf),
+		u);
+	int32_t n1 = bc_noise_lerp(
+		bc_noise_grad2(bc_noise_hash(a + yi + 1), xf, yf - NOISE_ONE),
+		bc_noise_grad2(bc_noise_hash(b + yi + 1), xf - NOISE_ONE, yf - NOISE_ONE),
+		u);
+
+	return bc_noise_lerp(n0, n1, bc_noise_fade(yf));
+}
+
+static int32_t bc_noise3(float x, float y, float z) {
+	int32_t xi, xf, yi, yf, zi, zf;
+	bc_noise_split(x, &xi, &xf);
+	bc_noise_split(y, &yi, &yf);
+	bc_noise_split(z, &zi, &zf);
+
+	uint8_t a = bc_noise_hash(xi);
+	uint8_t b = bc_noise_hash(xi + 1);
+	uint8_t aa = bc_noise_hash(a + yi);
+	uint8_t ab = bc_noise_hash(a + yi + 1);
+	uint8_t ba = bc_noise_hash(b + yi);
+	uint8_t bb = bc_noise_hash(b + yi + 1);
 
-	if (sRng == 0) {
-		sRng = 1;
+	int32_t u = bc_noise_fade(xf);
+	int32_t v = bc_noise_fade(yf);
+	int32_t x1 = xf - NOISE_ONE;
+	int32_t y1 = yf - NOISE_ONE;
+	int32_t z1 = zf - NOISE_ONE;
+
+	int32_t n00 = bc_noise_lerp(
+		bc_noise_grad3(bc_noise_hash(aa + zi), xf, yf, zf),
+		bc_noise_grad3(bc_noise_hash(ba + zi), x1, yf, zf),
+		u);
+	int32_t n10 = bc_noise_lerp(
+		bc_noise_grad3(bc_noise_hash(ab + zi), xf, y1, zf),
+		bc_noise_grad3(bc_noise_hash(bb + zi), x1, y1, zf),
+		u);
+	int32_t n01 = bc_noise_lerp(
+		bc_noise_grad3(bc_noise_hash(aa + zi + 1), xf, yf, z1),
+		bc_noise_grad3(bc_noise_hash(ba + zi + 1), x1, yf, z1),
+		u);
+	int32_t n11 = bc_noise_lerp(
+		bc_noise_grad3(bc_noise_hash(ab + zi + 1), xf, y1, z1),
+		bc_noise_grad3(bc_noise_hash(bb + zi + 1), x1, y1, z1),
+		u);
+
+	return bc_noise_lerp(
+		bc_noise_lerp(n00, n10, v),
+		bc_noise_lerp(n01, n11, v),
+		bc_noise_fade(zf));
+}
+
+static inline bool bc_noise_octaves(struct BytecodeVm *vm, float imm, uint32_t *octaves) {
+	*octaves = (uint32_t) imm;
+
+	if (*octaves < 1 || *octaves > BC_NOISE_MAX_OCTAVES) {
+		ERROR("fbm octave count out of range (%d)", (int) imm);
+		return false;
 	}
-	sRng = (sRng >> 1) ^ (-(sRng & 1) & 0x80200003);
+
+	return true;
 }
 
-static uint8_t bc_crc(uint8_t *bytecode, size_t len) {
-	uint8_t crc = 0;
+// Octave i is sampled at 2^i times the frequency and weighted by 2^-i, then
+// the sum is normalized back to the range of a single octave
+static float bc_noise_fbm(uint32_t octaves, float x, float y, float z, uint32_t dims) {
+	int32_t sum = 0;
+	int32_t norm = 0;
+	float freq = 1.0f;
 
-	for (size_t i = 1; i < len; i++) {
-		crc ^= bytecode[i];
+	for (uint32_t i = 0; i < octaves; i++) {
+		int32_t n;
 
-		for (uint32_t j = 0; j < 8; j++) {
-			if (crc & 0x80) {
-				crc <<= 1;
-				crc ^= 0x31;
-			} else {
-				crc <<= 1;
-			}
+		switch (dims) {
+			case 1:
+				n = bc_noise1(x * freq);
+				break;
+
+			case 2:
+				n = bc_noise2(x * freq, y * freq);
+				break;
+
+			default:
+				n = bc_noise3(x * freq, y * freq, z * freq);
+				break;
 		}
+
+		sum += n >> i;
+		norm += NOISE_ONE >> i;
+		freq *= 2.0f;
 	}
 
-	return crc;
+	return (float) sum / norm;
 }
 
-static size_t bc_len(uint8_t *bytecode) {
-	size_t len = 8;
+static void bc_op_noise1r(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = (float) bc_noise1(vm->registers[reg1]) / NOISE_ONE;
+}
 
-	while (len < BC_MAX_LEN) {
-		if (
-			bytecode[len - 8] == 0xFF &&
-			bytecode[len - 7] == 0xFF &&
-			bytecode[len - 6] == 0xFF &&
-			bytecode[len - 5] == 0xFF &&
-			bytecode[len - 4] == 0xFF &&
-			bytecode[len - 3] == 0xFF &&
-			bytecode[len - 2] == 0xFF &&
-			bytecode[len - 1] == 0xFF) {
-			break;
-		}
+static void bc_op_noise2r(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = (float) bc_noise2(vm->registers[reg1], vm->registers[reg2]) / NOISE_ONE;
+}
 
-		len++;
+static void bc_op_noise3r(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	uint8_t reg3 = bc_next_u8(vm);
+	vm->registers[reg0] = (float) bc_noise3(vm->registers[reg1], vm->registers[reg2], vm->registers[reg3]) / NOISE_ONE;
+}
+
+static void bc_op_fbm1i(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+
+	uint32_t octaves;
+	if (bc_noise_octaves(vm, imm, &octaves)) {
+		vm->registers[reg0] = bc_noise_fbm(octaves, vm->registers[reg1], 0.0f, 0.0f, 1);
 	}
+}
 
-	return len;
+static void bc_op_fbm2i(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+
+	uint32_t octaves;
+	if (bc_noise_octaves(vm, imm, &octaves)) {
+		vm->registers[reg0] = bc_noise_fbm(octaves, vm->registers[reg1], vm->registers[reg2], 0.0f, 2);
+	}
+}
+
+static void bc_op_fbm3i(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	uint8_t reg3 = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+
+	uint32_t octaves;
+	if (bc_noise_octaves(vm, imm, &octaves)) {
+		vm->registers[reg0] = bc_noise_fbm(octaves, vm->registers[reg1], vm->registers[reg2], vm->registers[reg3], 3);
+	}
+}
+
+#undef NOISE_ONE
+
+/* Palette instructions */
+
+static inline bool bc_check_palette(struct BytecodeVm *vm, size_t pal) {
+	if (pal >= BC_PALETTE_COUNT) {
+		ERROR("palette out of range (%d)", pal);
+		return false;
+	}
+
+	return true;
 }
 
-static void bc_execute(void) {
-	if (sError) {
+// Resamples count colour stops (3 floats each, starting at addr in memory)
+// into a palette. Stops are spaced evenly and the last one blends back into
+// the first, so palettes wrap around like the positions used to look them up.
+static void bc_palette_load(struct BytecodeVm *vm, size_t pal, size_t addr, size_t count) {
+	if (!bc_check_palette(vm, pal)) {
 		return;
 	}
 
-	sInstrs = 0;
-	sRunning = true;
+	if (count < 1 || count > BC_PALETTE_SIZE) {
+		ERROR("palette stop count out of range (%d)", count);
+		return;
+	}
 
-	memset(sRegisters, 0, sizeof(sRegisters));
-	sPc = 2;
+	for (size_t i = 0; i < BC_PALETTE_SIZE; i++) {
+		float stop = (float) (i * count) / BC_PALETTE_SIZE;
+		size_t k = (size_t) stop;
+		float t = stop - k;
 
-	while (sRunning) {
-		if (sPc >= gBytecodeLen) {
-			sRunning = false;
-			break;
-		}
+		size_t a = addr + k * 3;
+		size_t b = addr + (k + 1) % count * 3;
 
-		uint8_t opcode = gBytecode[sPc];
-		sPc++;
+		for (size_t c = 0; c < 3; c++) {
+			float val = bc_read_mem(vm, a + c) * (1.0f - t) + bc_read_mem(vm, b + c) * t;
+			vm->palettes[pal][i][c] = val < 0.0f ? 0 : val > 65535.0f ? 65535 : (uint16_t) (val + 0.5f);
+		}
 
-		if (sOps[opcode] == NULL) {
-			ERROR("invalid opcode %02x", opcode);
-			break;
+		if (vm->error) {
+			return;
 		}
+	}
+}
+
+// Positions wrap to [0, 1) and blend the two nearest entries with 8 bits of
+// fraction
+static void bc_palette_write(struct BytecodeVm *vm, size_t pal, float pos) {
+	if (!bc_check_palette(vm, pal)) {
+		return;
+	}
 
-		sOps[opcode]();
-		sInstrs++;
+	uint32_t idx = (uint32_t) ((pos - floorf(pos)) * (BC_PALETTE_SIZE << 8));
+	uint32_t t = idx & 0xFF;
+	uint16_t *a = vm->palettes[pal][(idx >> 8) % BC_PALETTE_SIZE];
+	uint16_t *b = vm->palettes[pal][((idx >> 8) + 1) % BC_PALETTE_SIZE];
 
-		if (sInstrs > BC_MAX_INSTRS) {
-			ERROR("exceeded instruction cap");
-			break;
-		}
+	vm->strip[vm->curLed][0] = (a[0] * (256 - t) + b[0] * t) >> 8;
+	vm->strip[vm->curLed][1] = (a[1] * (256 - t) + b[1] * t) >> 8;
+	vm->strip[vm->curLed][2] = (a[2] * (256 - t) + b[2] * t) >> 8;
+}
+
+static void bc_op_palloadi(struct BytecodeVm *vm) {
+	float imm0 = bc_next_f32(vm);
+	float imm1 = bc_next_f32(vm);
+	float imm2 = bc_next_f32(vm);
+	bc_palette_load(vm, (size_t) imm0, (size_t) imm1, (size_t) imm2);
+}
+
+static void bc_op_pali(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	float imm = bc_next_f32(vm);
+	bc_palette_write(vm, (size_t) imm, vm->registers[reg]);
+}
+
+static void bc_op_palr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	bc_palette_write(vm, (size_t) vm->registers[reg1], vm->registers[reg0]);
+}
+
+/* Fast math instructions */
 
-		bc_update_rng();
+// Cheaper stand-ins for the libm calls above, accurate to well within a step
+// of 8-bit colour. Sine and cosine interpolate a table (abs error < 1e-4 for
+// |x| <= 100), arctangent is a polynomial (abs error < 2e-5 rad) and square
+// root is a refined reciprocal square root estimate (rel error < 1e-5).
+// Tangent is sine over cosine, so its error grows with its slope: below
+// 2e-4 * (1 + tan^2 x) while |tan x| < 100, and closer to the poles it can
+// come out infinite or with the wrong sign. tools/render/test/fastmath.c
+// checks these bounds.
+
+static inline float bc_fast_sin_turns(float t) {
+	t -= BC_SIN_TABLE_SIZE * floorf(t / BC_SIN_TABLE_SIZE);
+
+	size_t i = (size_t) t;
+	if (i >= BC_SIN_TABLE_SIZE) {
+		return sSinTable[0];
 	}
+
+	return sSinTable[i] + (sSinTable[i + 1] - sSinTable[i]) * (t - i);
 }
 
-static void bc_task(void *pvParameters) {
-	while (true) {
-		strip_suspend();
-		strip_reset();
+static inline float bc_fast_sin(float x) {
+	return bc_fast_sin_turns(x * (BC_SIN_TABLE_SIZE / (2.0f * (float) M_PI)));
+}
 
-		switch (gBytecode[1]) {
-			case BC_MODE_PER_LED:
-				for (sCurLed = 0; sCurLed < STRIP_LED_COUNT; sCurLed++) {
-					bc_execute();
-				}
-				break;
+static inline float bc_fast_cos(float x) {
+	return bc_fast_sin_turns(x * (BC_SIN_TABLE_SIZE / (2.0f * (float) M_PI)) + BC_SIN_TABLE_SIZE / 4);
+}
 
-			case BC_MODE_PER_TICK:
-				bc_execute();
-				break;
-		}
+static inline float bc_fast_atan2(float y, float x) {
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+
+	if (ax == 0.0f && ay == 0.0f) {
+		return 0.0f;
+	}
 
-		strip_resume();
+	float z = ax > ay ? ay / ax : ax / ay;
+	float z2 = z * z;
+	float a = z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
 
-		if (sError) {
-			sError = false;
-			continue;
-		}
+	if (ay > ax) {
+		a = (float) M_PI_2 - a;
+	}
+	if (x < 0.0f) {
+		a = (float) M_PI - a;
+	}
 
-		sTicks++;
+	return y < 0.0f ? -a : a;
+}
 
-		TickType_t delay = pdMS_TO_TICKS(sPeriodMs);
-		xTaskNotifyWait(0, 0, NULL, delay < 1 ? 1 : delay);
+static inline float bc_fast_sqrt(float x) {
+	if (x <= 0.0f) {
+		return x == 0.0f ? 0.0f : NAN;
 	}
+
+	union {
+		float f;
+		uint32_t i;
+	} cast = { .f = x };
+
+	cast.i = 0x5F375A86 - (cast.i >> 1);
+
+	float y = cast.f;
+	y *= 1.5f - 0.5f * x * y * y;
+	y *= 1.5f - 0.5f * x * y * y;
+
+	return x * y;
 }
 
-void bc_init(void) {
-	bc_update(sInitBytecode, false);
+static void bc_op_fsinr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_fast_sin(vm->registers[reg1]);
 }
 
-void bc_start(void) {
-	xTaskCreatePinnedToCore(
-		&bc_task,
-		"bc_task",
-		BC_TASK_STACK_SIZE_BYTES,
-		NULL,
-		BC_TASK_PRIORITY,
-		&sBytecodeTask,
-		BC_TASK_CORE);
+static void bc_op_fcosr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_fast_cos(vm->registers[reg1]);
 }
 
-bool bc_update(uint8_t *bytecode, bool checkCrc) {
-	size_t len = bc_len(bytecode);
+static void bc_op_ftanr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_fast_sin(vm->registers[reg1]) / bc_fast_cos(vm->registers[reg1]);
+}
 
-	if (checkCrc) {
-		uint8_t crc = bc_crc(bytecode, len);
-		if (bytecode[0] != crc) {
-			return false;
-		}
+static void bc_op_fatan2r(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_fast_atan2(vm->registers[reg1], vm->registers[reg2]);
+}
+
+static void bc_op_fsqrtr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_fast_sqrt(vm->registers[reg1]);
+}
+
+/* Configuration instructions 2 */
+
+static void bc_op_posi(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	bc_set_cur_led(vm, (size_t) imm);
+}
+
+static void bc_op_posr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	bc_set_cur_led(vm, (size_t) vm->registers[reg]);
+}
+
+static void bc_op_posendi(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	bc_set_cur_led(vm, vm->ledCount - (size_t) imm);
+}
+
+static void bc_op_posendr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	bc_set_cur_led(vm, vm->ledCount - (size_t) vm->registers[reg]);
+}
+
+static void bc_op_getx(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = gLayout[vm->curLed].norm[0];
+}
+
+static void bc_op_gety(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = gLayout[vm->curLed].norm[1];
+}
+
+static void bc_op_getz(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = gLayout[vm->curLed].norm[2];
+}
+
+static void bc_op_getpolar(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->registers[reg] = gLayout[vm->curLed].angle;
+	vm->registers[(uint8_t) (reg + 1)] = gLayout[vm->curLed].radius;
+}
+
+/* Framebuffer instructions */
+
+// Colours are read from three consecutive registers, starting at the one given
+
+static void bc_op_fillr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+
+	size_t start = (size_t) vm->registers[reg0];
+	size_t count = (size_t) vm->registers[reg1];
+	if (!bc_check_range(vm, start, count)) {
+		return;
 	}
 
-	sTicks = 0;
-	sPeriodMs = 1000;
-	memset(sMemory, 0, sizeof(sMemory));
+	uint32_t red = (uint32_t) vm->registers[reg2];
+	uint32_t green = (uint32_t) vm->registers[(uint8_t) (reg2 + 1)];
+	uint32_t blue = (uint32_t) vm->registers[(uint8_t) (reg2 + 2)];
 
-	memcpy(gBytecode, bytecode, len);
-	gBytecodeLen = len;
+	start += vm->ledStart;
+	for (size_t i = start; i < start + count; i++) {
+		vm->strip[i][0] = red;
+		vm->strip[i][1] = green;
+		vm->strip[i][2] = blue;
+	}
+}
 
-	return true;
+// Within this frame, so only what it has drawn so far. Scrolling what was
+// shown last goes through prevcopyr.
+static void bc_op_copyr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+
+	size_t dest = (size_t) vm->registers[reg0];
+	size_t src = (size_t) vm->registers[reg1];
+	size_t count = (size_t) vm->registers[reg2];
+	if (!bc_check_range(vm, dest, count) || !bc_check_range(vm, src, count)) {
+		return;
+	}
+
+	memmove(vm->strip[vm->ledStart + dest], vm->strip[vm->ledStart + src], count * sizeof(vm->strip[0]));
 }
 
-void bc_interrupt(void) {
-	xTaskNotifyGive(sBytecodeTask);
+static void bc_op_blitr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+
+	size_t start = (size_t) vm->registers[reg0];
+	size_t addr = (size_t) vm->registers[reg1];
+	size_t count = (size_t) vm->registers[reg2];
+	if (!bc_check_range(vm, start, count)) {
+		return;
+	}
+
+	if (addr > BC_MEMORY_SIZE || count * 3 > BC_MEMORY_SIZE - addr) {
+		ERROR("out of bounds memory read (addr %04x, count %d)", addr, count);
+		return;
+	}
+
+	float *mem = &vm->memory[addr];
+	start += vm->ledStart;
+	for (size_t i = start; i < start + count; i++) {
+		vm->strip[i][0] = (uint32_t) *mem++;
+		vm->strip[i][1] = (uint32_t) *mem++;
+		vm->strip[i][2] = (uint32_t) *mem++;
+	}
 }
 
+static void bc_op_gradr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	uint8_t reg3 = bc_next_u8(vm);
+
+	size_t start = (size_t) vm->registers[reg0];
+	size_t count = (size_t) vm->registers[reg1];
+	if (!bc_check_range(vm, start, count)) {
+		return;
+	}
+
+	float from[3];
+	float step[3];
+	for (size_t c = 0; c < 3; c++) {
+		from[c] = vm->registers[(uint8_t) (reg2 + c)];
+		step[c] = count > 1 ? (vm->registers[(uint8_t) (reg3 + c)] - from[c]) / (count - 1) : 0.0f;
+	}
+
+	start += vm->ledStart;
+
+	for (size_t i = 0; i < count; i++) {
+		vm->strip[start + i][0] = (uint32_t) (from[0] + step[0] * i);
+		vm->strip[start + i][1] = (uint32_t) (from[1] + step[1] * i);
+		vm->strip[start + i][2] = (uint32_t) (from[2] + step[2] * i);
+	}
+}
+
+// Reads the previous frame at an offset from the current LED, so the result
+// doesn't depend on the order LEDs are rendered in this frame
+
+static inline void bc_read_prev(struct BytecodeVm *vm, uint8_t reg, int32_t pos) {
+	vm->impure = true;
+	vm->registers[reg] = (float) vm->prevStrip[pos][0];
+	vm->registers[(uint8_t) (reg + 1)] = (float) vm->prevStrip[pos][1];
+	vm->registers[(uint8_t) (reg + 2)] = (float) vm->prevStrip[pos][2];
+}
+
+static void bc_op_prevwr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+
+	int32_t pos = ((int32_t) vm->curLed + (int32_t) vm->registers[reg1]) % STRIP_LED_COUNT;
+	bc_read_prev(vm, reg0, pos < 0 ? pos + STRIP_LED_COUNT : pos);
+}
+
+static void bc_op_prevcr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+
+	int32_t pos = (int32_t) vm->curLed + (int32_t) vm->registers[reg1];
+	bc_read_prev(vm, reg0, pos < 0 ? 0 : pos >= STRIP_LED_COUNT ? STRIP_LED_COUNT - 1 : pos);
+}
+
+// Like copyr, but from the previous frame, so a scroll or chase only has to
+// draw the LEDs coming in
+static void bc_op_prevcopyr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+
+	size_t dest = (size_t) vm->registers[reg0];
+	size_t src = (size_t) vm->registers[reg1];
+	size_t count = (size_t) vm->registers[reg2];
+	if (!bc_check_range(vm, dest, count) || !bc_check_range(vm, src, count)) {
+		return;
+	}
+
+	vm->impure = true;
+	memcpy(vm->strip[vm->ledStart + dest], vm->prevStrip[vm->ledStart + src], count * sizeof(vm->strip[0]));
+}
+
+/* Integer instructions */
+
+// Integer registers live alongside the float ones. Arithmetic wraps around
+// like unsigned math instead of overflowing, and shift amounts are taken
+// modulo 32.
+
+static void bc_op_imovi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg] = imm;
+}
+
+static void bc_op_imovr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1];
+}
+
+static void bc_op_iaddi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] + (uint32_t) imm);
+}
+
+static void bc_op_iaddr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] + (uint32_t) vm->intRegisters[reg2]);
+}
+
+static void bc_op_isubr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] - (uint32_t) vm->intRegisters[reg2]);
+}
+
+static void bc_op_imuli(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] * (uint32_t) imm);
+}
+
+static void bc_op_imulr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] * (uint32_t) vm->intRegisters[reg2]);
+}
+
+static void bc_op_idivi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t div = bc_next_i32(vm);
+
+	if (div == 0) {
+		ERROR("idivi by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_div(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_idivr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	int32_t div = vm->intRegisters[reg2];
+
+	if (div == 0) {
+		ERROR("idivr by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_div(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_imodi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t div = bc_next_i32(vm);
+
+	if (div == 0) {
+		ERROR("imodi by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_mod(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_imodr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	int32_t div = vm->intRegisters[reg2];
+
+	if (div == 0) {
+		ERROR("imodr by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_mod(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_iremi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t div = bc_next_i32(vm);
+
+	if (div == 0) {
+		ERROR("iremi by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_rem(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_iremr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	int32_t div = vm->intRegisters[reg2];
+
+	if (div == 0) {
+		ERROR("iremr by zero");
+	} else {
+		vm->intRegisters[reg0] = bc_int_rem(vm->intRegisters[reg1], div);
+	}
+}
+
+static void bc_op_iandi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] & imm;
+}
+
+static void bc_op_iandr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] & vm->intRegisters[reg2];
+}
+
+static void bc_op_iori(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] | imm;
+}
+
+static void bc_op_iorr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] | vm->intRegisters[reg2];
+}
+
+static void bc_op_ixori(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] ^ imm;
+}
+
+static void bc_op_ixorr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	uint8_t reg2 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] ^ vm->intRegisters[reg2];
+}
+
+static void bc_op_inotr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = ~vm->intRegisters[reg1];
+}
+
+static void bc_op_ishli(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] << (imm & 31));
+}
+
+static void bc_op_ishri(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = (int32_t) ((uint32_t) vm->intRegisters[reg1] >> (imm & 31));
+}
+
+static void bc_op_isari(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->intRegisters[reg0] = vm->intRegisters[reg1] >> (imm & 31);
+}
+
+static void bc_op_iceqi(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->compare = vm->intRegisters[reg] == imm;
+}
+
+static void bc_op_iceqr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->intRegisters[reg0] == vm->intRegisters[reg1];
+}
+
+static void bc_op_iclti(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->compare = vm->intRegisters[reg] < imm;
+}
+
+static void bc_op_icltr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->intRegisters[reg0] < vm->intRegisters[reg1];
+}
+
+static void bc_op_iclei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->compare = vm->intRegisters[reg] <= imm;
+}
+
+static void bc_op_icler(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->intRegisters[reg0] <= vm->intRegisters[reg1];
+}
+
+static void bc_op_icgti(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->compare = vm->intRegisters[reg] > imm;
+}
+
+static void bc_op_icgtr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->intRegisters[reg0] > vm->intRegisters[reg1];
+}
+
+static void bc_op_icgei(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	int32_t imm = bc_next_i32(vm);
+	vm->compare = vm->intRegisters[reg] >= imm;
+}
+
+static void bc_op_icger(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->compare = vm->intRegisters[reg0] >= vm->intRegisters[reg1];
+}
+
+static void bc_op_itof(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = (float) vm->intRegisters[reg1];
+}
+
+static void bc_op_ftoi(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->intRegisters[reg0] = (int32_t) vm->registers[reg1];
+}
+
+static void bc_op_igetticks(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->intRegisters[reg] = (int32_t) bc_ticks(vm);
+}
+
+static void bc_op_igetpos(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->intRegisters[reg] = (int32_t) (vm->curLed - vm->ledStart);
+}
+
+static void bc_op_igetx(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->intRegisters[reg] = gLayout[vm->curLed].pos[0];
+}
+
+static void bc_op_igety(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->intRegisters[reg] = gLayout[vm->curLed].pos[1];
+}
+
+static void bc_op_igetz(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->intRegisters[reg] = gLayout[vm->curLed].pos[2];
+}
+
+static void bc_op_iposr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	bc_set_cur_led(vm, (size_t) (uint32_t) vm->intRegisters[reg]);
+}
+
+static void bc_op_iredr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][0] = (uint32_t) vm->intRegisters[reg];
+}
+
+static void bc_op_igreenr(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][1] = (uint32_t) vm->intRegisters[reg];
+}
+
+static void bc_op_ibluer(struct BytecodeVm *vm) {
+	uint8_t reg = bc_next_u8(vm);
+	vm->strip[vm->curLed][2] = (uint32_t) vm->intRegisters[reg];
+}
+
+static void bc_op_iloadr(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	vm->registers[reg0] = bc_read_mem(vm, (size_t) (uint32_t) vm->intRegisters[reg1]);
+}
+
+static void bc_op_istorer(struct BytecodeVm *vm) {
+	uint8_t reg0 = bc_next_u8(vm);
+	uint8_t reg1 = bc_next_u8(vm);
+	bc_write_mem(vm, (size_t) (uint32_t) vm->intRegisters[reg1], vm->registers[reg0]);
+}
+
+/* Render configuration instructions */
+
+static void bc_op_interpi(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+	*vm->stripInterpolate = imm != 0.0f;
+}
+
+static void bc_cache_free(struct BytecodeVm *vm) {
+	heap_caps_free(vm->cacheFrames);
+
+	vm->cacheFrames = NULL;
+	vm->cacheFlags = NULL;
+	vm->cachePeriod = 0;
+}
+
+// Frames followed by a flags byte for each
+static size_t bc_cache_size(uint32_t period) {
+	return period * (sizeof(((struct BytecodeVm *) NULL)->cacheFrames[0]) + 1);
+}
+
+// Small caches go in internal RAM and bigger ones in PSRAM, each falling back
+// on the other when there's no room
+static uint8_t *bc_cache_buffer(size_t size) {
+	uint32_t preferred = size <= BC_CACHE_INTERNAL_SIZE ? MALLOC_CAP_INTERNAL : MALLOC_CAP_SPIRAM;
+	uint8_t *buf = heap_caps_malloc(size, preferred | MALLOC_CAP_8BIT);
+
+	if (buf == NULL) {
+		buf = heap_caps_malloc(size, (preferred ^ (MALLOC_CAP_INTERNAL | MALLOC_CAP_SPIRAM)) | MALLOC_CAP_8BIT);
+	}
+
+	return buf;
+}
+
+// Without room for the cache, the program still runs, just uncached. That's
+// counted in the stats, and bc_analyze reports it ahead of time.
+static void bc_cache_alloc(struct BytecodeVm *vm, uint32_t period) {
+	bc_cache_free(vm);
+
+	uint8_t *buf = bc_cache_buffer(bc_cache_size(period));
+	if (buf == NULL) {
+		vm->stats->cacheFailures++;
+		return;
+	}
+
+	vm->cacheFrames = (uint8_t (*)[STRIP_LED_COUNT][3]) buf;
+	vm->cacheFlags = buf + period * sizeof(vm->cacheFrames[0]);
+	vm->cachePeriod = period;
+	memset(vm->cacheFlags, 0, period);
+}
+
+static void bc_op_periodici(struct BytecodeVm *vm) {
+	float imm = bc_next_f32(vm);
+
+	uint32_t period = (uint32_t) imm;
+	if (period < 1 || period > BC_CACHE_MAX_PERIOD) {
+		ERROR("cache period out of range (%d)", (int) imm);
+		return;
+	}
+
+	if (period != vm->tickPeriod) {
+		vm->tickPeriod = period;
+
+		if (!vm->impure && !vm->sandbox && !vm->inLayer) {
+			bc_cache_alloc(vm, period);
+		}
+	}
+}
+
+static void bc_op_subsamplei(struct BytecodeVm *vm) {
+	float imm0 = bc_next_f32(vm);
+	float imm1 = bc_next_f32(vm);
+
+	vm->subsampleStep = imm0 < 1.0f ? 1 : (size_t) imm0;
+	vm->subsampleThreshold = imm1 < 0.0f ? 0 : (uint32_t) imm1;
+}
+
+/* Halt instruction */
+
+static void bc_op_halt(struct BytecodeVm *vm) {
+	vm->running = false;
+}
+
+#define OP(opcode, func, operands) bc_op_ ## func,
+#define OP_INT(opcode, func, operands) bc_op_ ## func,
+#define OP_ALIAS(opcode, func)
+#define OP_NONE(opcode) NULL,
+
+static void (*sOps[256])(struct BytecodeVm *vm) = {
+#include "files/ops.h"
+};
+
+#undef OP
+#undef OP_INT
+#undef OP_ALIAS
+#undef OP_NONE
+
+// One character per operand: r/x for a float/integer register, f/d for a
+// float/integer immediate and a for a code address
+#define OP(opcode, func, operands) operands,
+#define OP_INT(opcode, func, operands) operands,
+#define OP_ALIAS(opcode, func)
+#define OP_NONE(opcode) NULL,
+
+static const char *sOpOperands[256] = {
+#include "files/ops.h"
+};
+
+#undef OP
+#undef OP_INT
+#undef OP_ALIAS
+#undef OP_NONE
+
+#define OP(opcode, func, operands) #func,
+#define OP_INT(opcode, func, operands) #func,
+#define OP_ALIAS(opcode, func)
+#define OP_NONE(opcode) NULL,
+
+const char *gBytecodeOpNames[256] = {
+#include "files/ops.h"
+};
+
+#undef OP
+#undef OP_INT
+#undef OP_ALIAS
+#undef OP_NONE
+
+// Feature and rough cost of each instruction range, relative to a plain
+// arithmetic instruction. Framebuffer instructions are counted as touching
+// the whole strip and fbm as running four octaves.
+static const struct {
+	uint8_t first;
+	uint8_t last;
+	uint32_t feature;
+	uint32_t cost;
+} sOpClasses[] = {
+	{ 0x0E, 0x0E, BC_FEATURE_RANDOM, 1 },
+	{ 0x1D, 0x24, BC_FEATURE_TRIG, 8 },
+	{ 0x50, 0x53, BC_FEATURE_MEMORY, 1 },
+	{ 0x54, 0x57, BC_FEATURE_LED_STATE, 1 },
+	{ 0x60, 0x60, BC_FEATURE_NOISE, 4 },
+	{ 0x61, 0x61, BC_FEATURE_NOISE, 8 },
+	{ 0x62, 0x62, BC_FEATURE_NOISE, 16 },
+	{ 0x63, 0x63, BC_FEATURE_NOISE, 16 },
+	{ 0x64, 0x64, BC_FEATURE_NOISE, 32 },
+	{ 0x65, 0x65, BC_FEATURE_NOISE, 64 },
+	{ 0x68, 0x68, BC_FEATURE_PALETTE, BC_PALETTE_SIZE },
+	{ 0x69, 0x6A, BC_FEATURE_PALETTE, 2 },
+	{ 0x70, 0x74, BC_FEATURE_FAST_MATH, 2 },
+	{ 0x84, 0x87, BC_FEATURE_LAYOUT, 1 },
+	{ 0x88, 0x8B, BC_FEATURE_FRAMEBUFFER, STRIP_LED_COUNT },
+	{ 0x8C, 0x8D, BC_FEATURE_PREV_FRAME, 2 },
+	{ 0x8E, 0x8E, BC_FEATURE_PREV_FRAME, STRIP_LED_COUNT },
+	{ 0x90, 0x92, BC_FEATURE_RENDER_CONFIG, 1 },
+	{ 0xC0, 0xED, BC_FEATURE_INTEGER, 1 }
+};
+
+static void bc_update_rng(struct BytecodeVm *vm) {
+	if (vm->rng == 1) {
+		vm->rng = 0;
+		return;
+	}
+
+	if (vm->rng == 0) {
+		vm->rng = 1;
+	}
+	vm->rng = (vm->rng >> 1) ^ (-(vm->rng & 1) & 0x80200003);
+}
+
+static uint8_t bc_crc(uint8_t *bytecode, size_t len) {
+	uint8_t crc = 0;
+
+	for (size_t i = 1; i < len; i++) {
+		crc ^= bytecode[i];
+
+		for (uint32_t j = 0; j < 8; j++) {
+			if (crc & 0x80) {
+				crc <<= 1;
+				crc ^= 0x31;
+			} else {
+				crc <<= 1;
+			}
+		}
+	}
+
+	return crc;
+}
+
+static size_t bc_len(uint8_t *bytecode) {
+	size_t len = 8;
+
+	while (len < BC_MAX_LEN) {
+		if (
+			bytecode[len - 8] == 0xFF &&
+			bytecode[len - 7] == 0xFF &&
+			bytecode[len - 6] == 0xFF &&
+			bytecode[len - 5] == 0xFF &&
+			bytecode[len - 4] == 0xFF &&
+			bytecode[len - 3] == 0xFF &&
+			bytecode[len - 2] == 0xFF &&
+			bytecode[len - 1] == 0xFF) {
+			break;
+		}
+
+		len++;
+	}
+
+	return len;
+}
+
+/* Native effects */
+
+struct NativeEffect {
+	uint32_t hash;
+	void (*run)(struct BytecodeVm *vm);
+};
+
+// Native code checks for the instruction cap and cancellation on backward
+// jumps, the only way it can run for long
+static bool bc_native_yield(struct BytecodeVm *vm) {
+	if (vm->instrs > BC_MAX_INSTRS) {
+		ERROR("exceeded instruction cap");
+		return true;
+	}
+
+	if (bc_stopped(vm)) {
+		vm->running = false;
+		return true;
+	}
+
+	return false;
+}
+
+#include "effects_native.h"
+
+static void bc_execute(struct BytecodeVm *vm) {
+	if (vm->error) {
+		return;
+	}
+
+	vm->instrs = 0;
+	vm->running = true;
+
+	// Native effects clear the registers they use themselves
+	if (vm->native != NULL) {
+		vm->native(vm);
+		vm->running = false;
+		vm->frameInstrs += vm->instrs;
+		return;
+	}
+
+	memset(vm->registers, 0, sizeof(vm->registers));
+	memset(vm->intRegisters, 0, sizeof(vm->intRegisters));
+	vm->pc = 2;
+
+	while (vm->running) {
+		if (vm->pc >= vm->len) {
+			vm->running = false;
+			break;
+		}
+
+		uint8_t opcode = vm->bytecode[vm->pc];
+		vm->pc++;
+
+		if (sOps[opcode] == NULL) {
+			ERROR("invalid opcode %02x", opcode);
+			break;
+		}
+
+		sOps[opcode](vm);
+		vm->instrs++;
+
+		if (vm->instrs > BC_MAX_INSTRS) {
+			ERROR("exceeded instruction cap");
+			break;
+		}
+
+		if (vm->instrs % BC_CANCEL_CHECK_INTERVAL == 0 && bc_stopped(vm)) {
+			vm->running = false;
+			break;
+		}
+
+		bc_update_rng(vm);
+	}
+
+	vm->frameInstrs += vm->instrs;
+}
+
+static void bc_execute_led(struct BytecodeVm *vm, size_t pos) {
+	vm->curLed = pos;
+	bc_execute(vm);
+	vm->stats->ledEvals++;
+}
+
+// With subsampling on, only every subsampleStep-th LED (and the last one) is
+// evaluated, and the LEDs between two samples are filled in linearly. Gaps
+// where the samples differ by more than subsampleThreshold in any channel
+// are evaluated in full instead.
+static void bc_render_leds(struct BytecodeVm *vm) {
+	size_t step = vm->subsampleStep;
+	size_t last = vm->ledStart + vm->ledCount - 1;
+
+	if (step <= 1) {
+		for (size_t i = vm->ledStart; i <= last && !bc_stopped(vm); i++) {
+			bc_execute_led(vm, i);
+
+			if (vm->pipelined) {
+				strip_stream_advance(i + 1);
+			}
+		}
+		return;
+	}
+
+	size_t prev = vm->ledStart;
+	bc_execute_led(vm, prev);
+
+	while (prev < last && !bc_stopped(vm)) {
+		size_t next = prev + step < last ? prev + step : last;
+		bc_execute_led(vm, next);
+
+		bool smooth = true;
+		for (size_t c = 0; c < 3; c++) {
+			uint32_t a = vm->strip[prev][c];
+			uint32_t b = vm->strip[next][c];
+			if ((a > b ? a - b : b - a) > vm->subsampleThreshold) {
+				smooth = false;
+			}
+		}
+
+		if (smooth) {
+			for (size_t i = prev + 1; i < next; i++) {
+				for (size_t c = 0; c < 3; c++) {
+					int64_t a = vm->strip[prev][c];
+					int64_t b = vm->strip[next][c];
+					vm->strip[i][c] = (uint32_t) (a + (b - a) * (int64_t) (i - prev) / (int64_t) (next - prev));
+				}
+			}
+
+			vm->stats->ledEvalsSkipped += next - prev - 1;
+		} else {
+			for (size_t i = prev + 1; i < next && !bc_stopped(vm); i++) {
+				bc_execute_led(vm, i);
+			}
+		}
+
+		if (vm->pipelined) {
+			strip_stream_advance(next + 1);
+		}
+
+		prev = next;
+	}
+}
+
+static void bc_reset(struct BytecodeVm *vm) {
+	vm->ticks = 0;
+	vm->periodMs = 1000;
+	vm->subsampleStep = 1;
+	vm->subsampleThreshold = 0;
+	vm->tickPeriod = 0;
+	vm->impure = false;
+	bc_cache_free(vm);
+	memset(vm->memory, 0, sizeof(vm->memory));
+	memset(vm->ledState, 0, sizeof(vm->ledState));
+	memset(vm->palettes, 0, sizeof(vm->palettes));
+	memset(vm->prevStrip, 0, sizeof(vm->prevStrip));
+}
+
+// FNV-1a, to tell whether two controllers run the same program
+static uint32_t bc_hash(const uint8_t *bytecode, size_t len) {
+	uint32_t hash = 0x811C9DC5;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ bytecode[i]) * 0x01000193;
+	}
+
+	return hash;
+}
+
+// The native translation of a program, if it's one of the stock effects. The
+// recorded hash catches a translation older than the effect.
+static void (*bc_native_find(const uint8_t *bytecode, size_t len))(struct BytecodeVm *vm) {
+	for (size_t i = 0; i < BC_EFFECT_COUNT; i++) {
+		const struct BytecodeEffect *effect = &gBytecodeEffects[i];
+
+		if (effect->len == len && memcmp(effect->bytecode, bytecode, len) == 0) {
+			return bc_hash(bytecode, len) == sNativeEffects[i].hash ? sNativeEffects[i].run : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+static int64_t bc_period_us(void) {
+	uint32_t periodMs = sAnchor.periodMs > portTICK_PERIOD_MS ? sAnchor.periodMs : portTICK_PERIOD_MS;
+	return (int64_t) periodMs * 1000;
+}
+
+// When the current tick is due, in shared time
+static int64_t bc_deadline(void) {
+	return sAnchor.us + (int32_t) (sVm.ticks - sAnchor.ticks) * bc_period_us();
+}
+
+// The first tick due at or after the given time
+static uint32_t bc_due_tick(int64_t now) {
+	if (now <= sAnchor.us) {
+		return sAnchor.ticks;
+	}
+
+	int64_t periodUs = bc_period_us();
+	return sAnchor.ticks + (now - sAnchor.us + periodUs - 1) / periodUs;
+}
+
+// When synced, a program with a start time waits for the frame due then, so
+// that controllers given the same time switch over on the same frame
+static void bc_activate(void) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	bool due = sPendingAt == 0 || gSyncRole == SYNC_ROLE_NONE || sPendingAt <= bc_deadline();
+
+	if (sPending && due) {
+		if (sPendingBytecode == sBytecodeAreas[sActiveArea ^ 1]) {
+			sActiveArea ^= 1;
+		}
+
+		gBytecode = sPendingBytecode;
+		gBytecodeLen = sPendingLen;
+		sVm.bytecode = gBytecode;
+		sVm.len = gBytecodeLen;
+		sVm.native = bc_native_find(gBytecode, gBytecodeLen);
+		sVm.pipelineOff = false;
+		sPending = false;
+
+		bc_reset(&sVm);
+
+		sAnchor.hash = sPendingHash;
+		sAnchor.ticks = 0;
+		sAnchor.periodMs = sVm.periodMs;
+		sAnchor.us = sPendingAt != 0 ? sPendingAt : sync_now();
+		sync_set_anchor(&sAnchor);
+	}
+
+	xSemaphoreGive(sUpdateLock);
+}
+
+// Lines the next frame up with shared time. A follower running the leader's
+// program takes over its schedule, ticks included.
+static void bc_schedule(void) {
+	int64_t now = sync_now();
+
+	struct SyncAnchor leader;
+	if (sync_leader_anchor(&leader) && leader.hash == sAnchor.hash && leader.periodMs == sAnchor.periodMs) {
+		int64_t deadline = leader.us + (int32_t) (sVm.ticks - leader.ticks) * bc_period_us();
+
+		if (deadline != bc_deadline()) {
+			sAnchor = leader;
+			sync_set_anchor(&sAnchor);
+			sVm.ticks = bc_due_tick(now);
+		}
+	}
+
+	int64_t deadline = bc_deadline();
+	int64_t periodUs = bc_period_us();
+
+	// More than a frame behind skips ahead, while being far ahead means the
+	// shared clock stepped back, so the schedule starts over from here. The
+	// anchor tick itself is never skipped, as the program may not have set
+	// its period yet.
+	if (sVm.ticks != sAnchor.ticks && now - deadline > periodUs) {
+		sVm.ticks = bc_due_tick(now);
+	} else if (deadline - now > SYNC_MAX_LEAD_FRAMES * periodUs) {
+		sAnchor.us = now;
+		sAnchor.ticks = sVm.ticks;
+		sync_set_anchor(&sAnchor);
+	}
+}
+
+// A program that changed its period re-anchors at the frame it just ran, so
+// the ticks before keep their times and the rest follow the new period
+static void bc_anchor_period(void) {
+	if (sVm.periodMs != sAnchor.periodMs) {
+		sAnchor.us = bc_deadline();
+		sAnchor.ticks = sVm.ticks;
+		sAnchor.periodMs = sVm.periodMs;
+		sync_set_anchor(&sAnchor);
+	}
+}
+
+static void bc_wake(void *arg) {
+	xTaskNotifyGive(sBytecodeTask);
+}
+
+// Sleeps until the given shared time. RTOS ticks are too coarse to line
+// frames up across controllers, so a timer does the waking. If the shared
+// clock steps back meanwhile, the frame goes out right away and the next
+// bc_schedule sorts things out. Returns false when cut short by an update.
+static bool bc_wait_until(int64_t deadline) {
+	bool slept = false;
+
+	while (!sVm.cancel) {
+		int64_t remaining = deadline - sync_now();
+		if (remaining <= 0 || remaining > SYNC_MAX_LEAD_FRAMES * bc_period_us()) {
+			// Late frames still leave the rest of the core a tick, like the
+			// unsynced delay does
+			if (!slept) {
+				vTaskDelay(1);
+			}
+
+			return true;
+		}
+
+		esp_timer_start_once(sWakeTimer, remaining);
+		xTaskNotifyWait(0, 0, NULL, pdMS_TO_TICKS(remaining / 1000) + 1);
+		esp_timer_stop(sWakeTimer);
+		slept = true;
+	}
+
+	return false;
+}
+
+static void bc_layers_activate(void) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	for (size_t i = 0; i < BC_MAX_LAYERS; i++) {
+		if (!sLayerPending[i]) {
+			continue;
+		}
+
+		if (sPendingLayers[i].len > 0) {
+			sLayerActiveArea[i] ^= 1;
+		}
+
+		sLayers[i] = sPendingLayers[i];
+		sLayerNatives[i] = bc_native_find(sLayerAreas[i][sLayerActiveArea[i]], sLayers[i].len);
+		sLayerPending[i] = false;
+
+		sLayerSettings[i] = (struct LayerSettings) {
+			.periodMs = 1000,
+			.subsampleStep = 1
+		};
+	}
+
+	xSemaphoreGive(sUpdateLock);
+}
+
+static bool bc_layers_active(void) {
+	for (size_t i = 0; i < BC_MAX_LAYERS; i++) {
+		if (sLayers[i].len > 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void bc_layer_swap(struct BytecodeVm *vm, struct LayerSettings *settings) {
+	struct LayerSettings active = {
+		.ticks = vm->ticks,
+		.periodMs = vm->periodMs,
+		.subsampleStep = vm->subsampleStep,
+		.subsampleThreshold = vm->subsampleThreshold,
+		.tickPeriod = vm->tickPeriod
+	};
+
+	vm->ticks = settings->ticks;
+	vm->periodMs = settings->periodMs;
+	vm->subsampleStep = settings->subsampleStep;
+	vm->subsampleThreshold = settings->subsampleThreshold;
+	vm->tickPeriod = settings->tickPeriod;
+
+	*settings = active;
+}
+
+// 8-bit channels, opacity 255 maps to a weight of 256 so it's exact
+static inline uint8_t bc_blend(uint8_t dest, uint8_t src, uint8_t blend, int32_t weight) {
+	int32_t mixed;
+
+	switch (blend) {
+		case BC_BLEND_ADD:
+			mixed = dest + src > 255 ? 255 : dest + src;
+			break;
+
+		case BC_BLEND_MAX:
+			mixed = src > dest ? src : dest;
+			break;
+
+		default:
+			mixed = src;
+			break;
+	}
+
+	return dest + (((mixed - dest) * weight) >> 8);
+}
+
+// Renders each layer over its own range, on a clear strip of its own, and
+// blends it into sComposite, which holds the active program's packed frame.
+// Layers keep their own ticks and render settings but share memory, LED
+// state and palettes with the active program. The active program's strip
+// data is put back afterwards, for the cache and the previous frame.
+static void bc_layers_render(struct BytecodeVm *vm) {
+	uint8_t *bytecode = vm->bytecode;
+	size_t len = vm->len;
+	void (*native)(struct BytecodeVm *vm) = vm->native;
+	size_t curLed = vm->curLed;
+	enum StripMode mode = *vm->stripMode;
+	bool interpolate = *vm->stripInterpolate;
+
+	vm->inLayer = true;
+
+	for (size_t i = 0; i < BC_MAX_LAYERS && !bc_stopped(vm); i++) {
+		struct BytecodeLayer *layer = &sLayers[i];
+		if (layer->len == 0) {
+			continue;
+		}
+
+		size_t start = layer->start;
+		size_t count = layer->count;
+
+		memcpy(&sLayerSaved[start], &vm->strip[start], count * sizeof(vm->strip[0]));
+		memset(&vm->strip[start], 0, count * sizeof(vm->strip[0]));
+		*vm->stripMode = STRIP_MODE_RGB;
+		*vm->stripInterpolate = false;
+
+		vm->bytecode = sLayerAreas[i][sLayerActiveArea[i]];
+		vm->len = layer->len;
+		vm->native = sLayerNatives[i];
+		vm->ledStart = start;
+		vm->ledCount = count;
+		vm->curLed = start;
+		bc_layer_swap(vm, &sLayerSettings[i]);
+
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+
+		bc_layer_swap(vm, &sLayerSettings[i]);
+
+		if (vm->error) {
+			vm->error = false;
+			vm->stats->errors++;
+
+			xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+			layer->len = 0;
+			xSemaphoreGive(sUpdateLock);
+		} else if (!bc_stopped(vm)) {
+			strip_pack_range(sLayerFrame, start, count);
+
+			uint8_t blend = layer->blend;
+			int32_t weight = blend == BC_BLEND_REPLACE ? 256 : layer->opacity + (layer->opacity >> 7);
+
+			for (size_t led = start; led < start + count; led++) {
+				for (size_t c = 0; c < 3; c++) {
+					sComposite[led][c] = bc_blend(sComposite[led][c], sLayerFrame[led][c], blend, weight);
+				}
+			}
+
+			sLayerSettings[i].ticks++;
+		}
+
+		memcpy(&vm->strip[start], &sLayerSaved[start], count * sizeof(vm->strip[0]));
+	}
+
+	vm->inLayer = false;
+
+	vm->bytecode = bytecode;
+	vm->len = len;
+	vm->native = native;
+	vm->ledStart = 0;
+	vm->ledCount = STRIP_LED_COUNT;
+	vm->curLed = curLed;
+	*vm->stripMode = mode;
+	*vm->stripInterpolate = interpolate;
+}
+
+// A sandboxed run's VM, rendering to a strip of its own. It's too big for a
+// task stack, so it comes from the heap.
+struct BytecodeSandbox {
+	struct BytecodeVm vm;
+	uint32_t strip[STRIP_LED_COUNT][3];
+	enum StripMode stripMode;
+	bool stripInterpolate;
+	struct BytecodeStats stats;
+};
+
+static struct BytecodeSandbox *bc_sandbox_new(uint8_t *bytecode, size_t len, bool native) {
+	struct BytecodeSandbox *sandbox = heap_caps_malloc(sizeof(*sandbox), MALLOC_CAP_8BIT);
+	if (sandbox == NULL) {
+		return NULL;
+	}
+
+	memset(sandbox, 0, sizeof(*sandbox));
+
+	struct BytecodeVm *vm = &sandbox->vm;
+	vm->bytecode = bytecode;
+	vm->len = len;
+	vm->native = native ? bc_native_find(bytecode, len) : NULL;
+	vm->strip = sandbox->strip;
+	vm->stripMode = &sandbox->stripMode;
+	vm->stripInterpolate = &sandbox->stripInterpolate;
+	vm->stats = &sandbox->stats;
+	vm->ledCount = STRIP_LED_COUNT;
+	vm->sandbox = true;
+	vm->deadline = INT64_MAX;
+	bc_reset(vm);
+
+	return sandbox;
+}
+
+// Like strip_reset, for whichever strip the VM renders to
+static void bc_strip_reset(struct BytecodeVm *vm) {
+	*vm->stripMode = STRIP_MODE_RGB;
+	*vm->stripInterpolate = false;
+	memset(vm->strip, 0, STRIP_LED_COUNT * sizeof(vm->strip[0]));
+}
+
+// Renders a few frames of the candidate in a sandbox, within
+// BC_TRIAL_BUDGET_US. The active program keeps rendering meanwhile.
+static void bc_trial_run(void) {
+	struct BytecodeAnalysis *analysis = sTrialAnalysis;
+
+	struct BytecodeSandbox *sandbox = bc_sandbox_new(sTrialBytecode, analysis->len, true);
+	if (sandbox == NULL) {
+		snprintf(analysis->error, sizeof(analysis->error), "not enough memory for a trial run");
+		return;
+	}
+
+	struct BytecodeVm *vm = &sandbox->vm;
+	vm->deadline = esp_timer_get_time() + BC_TRIAL_BUDGET_US;
+
+	uint64_t renderUs = 0;
+	uint64_t instrs = 0;
+
+	while (analysis->frames < BC_TRIAL_FRAMES) {
+		bc_strip_reset(vm);
+		vm->frameInstrs = 0;
+
+		int64_t start = esp_timer_get_time();
+
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+
+		if (vm->error) {
+			snprintf(analysis->error, sizeof(analysis->error), "%s", vm->message);
+			break;
+		}
+
+		if (bc_stopped(vm)) {
+			analysis->timedOut = true;
+			break;
+		}
+
+		uint32_t frameUs = esp_timer_get_time() - start;
+		if (frameUs > analysis->maxRenderUs) {
+			analysis->maxRenderUs = frameUs;
+		}
+
+		renderUs += frameUs;
+		instrs += vm->frameInstrs;
+		analysis->frames++;
+
+		memcpy(vm->prevStrip, vm->strip, sizeof(vm->prevStrip));
+		vm->ticks++;
+	}
+
+	analysis->periodMs = vm->periodMs;
+	analysis->tickPeriod = vm->tickPeriod;
+
+	// Sandboxes never cache, so this only checks there'd be room for it
+	if (vm->tickPeriod != 0 && !vm->impure) {
+		uint8_t *buf = bc_cache_buffer(bc_cache_size(vm->tickPeriod));
+		analysis->cacheFits = buf != NULL;
+		heap_caps_free(buf);
+	}
+
+	if (analysis->frames > 0) {
+		analysis->renderUs = renderUs / analysis->frames;
+		analysis->instrsPerFrame = instrs / analysis->frames;
+
+		TickType_t delay = pdMS_TO_TICKS(vm->periodMs);
+		if (delay < 1) {
+			delay = 1;
+		}
+
+		analysis->fps = 1000000.0f / (analysis->renderUs + delay * portTICK_PERIOD_MS * 1000);
+	}
+
+	heap_caps_free(sandbox);
+}
+
+// Builds a program that sets r1 and i1 to 1 and then runs the instruction
+// copies times. Register operands are 1, except for the first of several
+// which is 0, so divisors, counts and addresses all stay valid.
+static void bc_bench_build(struct BytecodeVm *vm, uint8_t opcode, size_t copies) {
+	static const uint8_t setup[] = {
+		/* checksum */ 0x00,
+		/* mode */ BC_MODE_PER_TICK,
+		/* 02: movi r1 1.0f */ 0x10, 0x01, 0x3F, 0x80, 0x00, 0x00,
+		/* 08: imovi i1 1   */ 0xC0, 0x01, 0x00, 0x00, 0x00, 0x01
+	};
+
+	memcpy(sBenchBytecode, setup, sizeof(setup));
+	size_t pc = sizeof(setup);
+
+	const char *operands = sOpOperands[opcode];
+
+	size_t len = 1;
+	size_t regs = 0;
+	for (const char *operand = operands; *operand != '\0'; operand++) {
+		if (*operand == 'r' || *operand == 'x') {
+			len += 1;
+			regs++;
+		} else {
+			len += 4;
+		}
+	}
+
+	for (size_t i = 0; i < copies; i++) {
+		size_t next = pc + len;
+		bool first = regs > 1;
+
+		sBenchBytecode[pc++] = opcode;
+
+		for (const char *operand = operands; *operand != '\0'; operand++) {
+			switch (*operand) {
+				case 'r':
+				case 'x':
+					sBenchBytecode[pc++] = first ? 0 : 1;
+					first = false;
+					break;
+
+				case 'f':
+					bc_store_u32(&sBenchBytecode[pc], 0x3F800000);
+					pc += 4;
+					break;
+
+				case 'd':
+					bc_store_u32(&sBenchBytecode[pc], 1);
+					pc += 4;
+					break;
+
+				case 'a':
+					bc_store_u32(&sBenchBytecode[pc], next);
+					pc += 4;
+					break;
+			}
+		}
+	}
+
+	memset(&sBenchBytecode[pc], 0xFF, 8);
+	vm->len = pc + 8;
+}
+
+// Fewest cycles over BC_BENCH_RUNS executions, which filters out interrupts
+static int64_t bc_bench_cycles(struct BytecodeVm *vm) {
+	uint32_t best = UINT32_MAX;
+
+	for (size_t run = 0; run < BC_BENCH_RUNS; run++) {
+		vm->compare = false;
+
+		uint32_t start = esp_cpu_get_cycle_count();
+		bc_execute(vm);
+		uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+		if (vm->error) {
+			vm->error = false;
+			return -1;
+		}
+
+		if (cycles < best) {
+			best = cycles;
+		}
+	}
+
+	return best;
+}
+
+static float bc_bench_reads(struct BytecodeVm *vm, size_t size) {
+	uint32_t best = UINT32_MAX;
+
+	for (size_t run = 0; run < BC_BENCH_RUNS; run++) {
+		uint32_t sink = 0;
+		vm->pc = 0;
+
+		uint32_t start = esp_cpu_get_cycle_count();
+		for (size_t i = 0; i < BC_BENCH_COPIES; i++) {
+			sink ^= size == 1 ? bc_next_u8(vm) : bc_next_u32(vm);
+		}
+		uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+		sBenchSink = sink;
+
+		if (cycles < best) {
+			best = cycles;
+		}
+	}
+
+	return (float) best / BC_BENCH_COPIES;
+}
+
+// Fewest cycles over BC_BENCH_RUNS first frames of a stock effect, 0 when
+// asked for native code it doesn't have
+static uint32_t bc_bench_effect(struct BytecodeVm *vm, const struct BytecodeEffect *effect, bool native) {
+	vm->bytecode = effect->bytecode;
+	vm->len = effect->len;
+	vm->native = native ? bc_native_find(vm->bytecode, vm->len) : NULL;
+
+	if (native && vm->native == NULL) {
+		return 0;
+	}
+
+	uint32_t best = UINT32_MAX;
+
+	for (size_t run = 0; run < BC_BENCH_RUNS; run++) {
+		bc_reset(vm);
+		bc_strip_reset(vm);
+
+		uint32_t start = esp_cpu_get_cycle_count();
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+		uint32_t cycles = esp_cpu_get_cycle_count() - start;
+		vm->error = false;
+
+		if (cycles < best) {
+			best = cycles;
+		}
+	}
+
+	return best;
+}
+
+// Times the active program's render and conversion, then every instruction,
+// then each stock effect interpreted and native.
+// An instruction's total is its share of a run of BC_BENCH_COPIES copies,
+// dispatch is the total of nop and decode comes from timing operand reads on
+// their own, which leaves the rest as the body.
+static void bc_bench_run(void) {
+	struct BytecodeBench *bench = &gBytecodeBench;
+	static uint8_t frame[STRIP_LED_COUNT][3];
+
+	memset(bench, 0, sizeof(*bench));
+
+	// Once replaced, the active program's area can be loaded over
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+	size_t len = gBytecodeLen;
+	uint8_t *bytecode = heap_caps_malloc(len, MALLOC_CAP_8BIT);
+	if (bytecode != NULL) {
+		memcpy(bytecode, gBytecode, len);
+	}
+	xSemaphoreGive(sUpdateLock);
+
+	struct BytecodeSandbox *sandbox = bytecode != NULL ? bc_sandbox_new(bytecode, len, true) : NULL;
+	if (sandbox == NULL) {
+		heap_caps_free(bytecode);
+		return;
+	}
+
+	struct BytecodeVm *vm = &sandbox->vm;
+
+	bench->cpuMhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+	bench->renderCycles = UINT32_MAX;
+	bench->packCycles = UINT32_MAX;
+
+	for (size_t run = 0; run < BC_BENCH_RUNS; run++) {
+		bc_strip_reset(vm);
+
+		uint32_t start = esp_cpu_get_cycle_count();
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+		uint32_t cycles = esp_cpu_get_cycle_count() - start;
+		vm->error = false;
+
+		if (cycles < bench->renderCycles) {
+			bench->renderCycles = cycles;
+		}
+
+		start = esp_cpu_get_cycle_count();
+		strip_pack_from(frame, vm->strip, *vm->stripMode, 0, STRIP_LED_COUNT);
+		cycles = esp_cpu_get_cycle_count() - start;
+
+		if (cycles < bench->packCycles) {
+			bench->packCycles = cycles;
+		}
+	}
+
+	bench->refreshUs = strip_time_refresh();
+
+	vm->bytecode = sBenchBytecode;
+	vm->native = NULL;
+
+	bench->decodeU8 = bc_bench_reads(vm, 1);
+	bench->decodeU32 = bc_bench_reads(vm, 4);
+
+	bc_bench_build(vm, 0x00, 0);
+	int64_t base = bc_bench_cycles(vm);
+
+	bc_bench_build(vm, 0x00, BC_BENCH_COPIES);
+	bench->dispatch = (float) (bc_bench_cycles(vm) - base) / BC_BENCH_COPIES;
+
+	for (size_t opcode = 0; opcode < 256; opcode++) {
+		if (sOps[opcode] == NULL || sOps[opcode] == bc_op_halt || sOps[opcode] == bc_op_haltf) {
+			continue;
+		}
+
+		bc_bench_build(vm, opcode, BC_BENCH_COPIES);
+
+		int64_t cycles = bc_bench_cycles(vm);
+		if (cycles < 0) {
+			continue;
+		}
+
+		struct BytecodeBenchOp *op = &bench->ops[opcode];
+
+		op->measured = true;
+		op->total = (float) (cycles - base) / BC_BENCH_COPIES;
+
+		for (const char *operand = sOpOperands[opcode]; *operand != '\0'; operand++) {
+			op->decode += *operand == 'r' || *operand == 'x' ? bench->decodeU8 : bench->decodeU32;
+		}
+
+		op->body = op->total - bench->dispatch - op->decode;
+		if (op->body < 0.0f) {
+			op->body = 0.0f;
+		}
+	}
+
+	for (size_t i = 0; i < BC_EFFECT_COUNT; i++) {
+		bench->effects[i].interpretedCycles = bc_bench_effect(vm, &gBytecodeEffects[i], false);
+		bench->effects[i].nativeCycles = bc_bench_effect(vm, &gBytecodeEffects[i], true);
+	}
+
+	heap_caps_free(sandbox);
+	heap_caps_free(bytecode);
+	bench->done = true;
+}
+
+static void bc_task(void *pvParameters) {
+	struct BytecodeVm *vm = &sVm;
+
+	while (true) {
+		vm->cancel = false;
+		bc_activate();
+		bc_layers_activate();
+		strip_reset();
+
+		if (gSyncRole != SYNC_ROLE_NONE) {
+			bc_schedule();
+		}
+
+		if (layout_activate() && vm->cacheFrames != NULL) {
+			memset(vm->cacheFlags, 0, vm->cachePeriod);
+		}
+
+		int64_t start = esp_timer_get_time();
+		bool cached = vm->cacheFrames != NULL && (vm->cacheFlags[bc_ticks(vm)] & BC_CACHE_FLAG_VALID);
+
+		if (!cached) {
+			// Per-LED programs render in strip order, so their frames can go
+			// out while they're still rendering. Layers and synced output
+			// need the whole frame first.
+			vm->pipelined =
+				vm->bytecode[1] == BC_MODE_PER_LED &&
+				!vm->pipelineOff &&
+				gSyncRole == SYNC_ROLE_NONE &&
+				!bc_layers_active() &&
+				strip_stream_begin();
+
+			switch (vm->bytecode[1]) {
+				case BC_MODE_PER_LED:
+					bc_render_leds(vm);
+					break;
+
+				case BC_MODE_PER_TICK:
+					bc_execute(vm);
+					break;
+			}
+
+			vm->pipelined = false;
+
+			if (vm->error) {
+				strip_stream_drop();
+				vm->error = false;
+				vm->stats->errors++;
+				continue;
+			}
+
+			// Drop the partial frame and start over with whatever is pending,
+			// the strip keeps showing the last published frame meanwhile
+			if (vm->cancel) {
+				strip_stream_drop();
+				xTaskNotifyStateClear(NULL);
+				vm->stats->cancelledFrames++;
+				continue;
+			}
+
+			if (vm->impure) {
+				bc_cache_free(vm);
+			}
+
+			vm->stats->frames++;
+		}
+
+		bool layered = bc_layers_active();
+
+		if (layered) {
+			if (cached) {
+				memcpy(sComposite, vm->cacheFrames[bc_ticks(vm)], sizeof(sComposite));
+			} else {
+				strip_pack(sComposite);
+			}
+
+			bc_layers_render(vm);
+
+			if (vm->cancel) {
+				xTaskNotifyStateClear(NULL);
+				vm->stats->cancelledFrames++;
+				continue;
+			}
+		}
+
+		TickType_t delay = pdMS_TO_TICKS(vm->periodMs);
+		if (delay < 1) {
+			delay = 1;
+		}
+
+		uint32_t interval = esp_timer_get_time() - start + delay * portTICK_PERIOD_MS * 1000;
+
+		// Synced frames go out when they're due rather than when they're ready
+		if (gSyncRole != SYNC_ROLE_NONE) {
+			bc_anchor_period();
+
+			if (!bc_wait_until(bc_deadline())) {
+				xTaskNotifyStateClear(NULL);
+				vm->stats->cancelledFrames++;
+				continue;
+			}
+
+			interval = bc_period_us();
+		}
+
+		if (vm->cacheFrames != NULL) {
+			uint32_t slot = bc_ticks(vm);
+
+			if (cached) {
+				vm->stats->cachedFrames++;
+			} else {
+				strip_pack(vm->cacheFrames[slot]);
+				vm->cacheFlags[slot] = BC_CACHE_FLAG_VALID | (*vm->stripInterpolate ? BC_CACHE_FLAG_INTERPOLATE : 0);
+			}
+
+			// Copied into the strip's front frame rather than handed over, as
+			// the strip and preview tasks go on reading that after the cache
+			// may have been freed. A replay costs a compare and a copy of one
+			// packed frame, with no VM work.
+			bool interpolate = vm->cacheFlags[slot] & BC_CACHE_FLAG_INTERPOLATE;
+			strip_publish_packed(layered ? sComposite : vm->cacheFrames[slot], interpolate, interval);
+		} else if (layered) {
+			memcpy(vm->prevStrip, vm->strip, sizeof(vm->prevStrip));
+			strip_publish_packed(sComposite, *vm->stripInterpolate, interval);
+		} else {
+			memcpy(vm->prevStrip, vm->strip, sizeof(vm->prevStrip));
+			strip_publish(interval);
+		}
+
+		vm->ticks++;
+
+		if (gSyncRole == SYNC_ROLE_NONE) {
+			xTaskNotifyWait(0, 0, NULL, delay);
+		}
+	}
+}
+
+static void bc_sandbox_task(void *pvParameters) {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		sSandboxJob();
+		xSemaphoreGive(sSandboxDone);
+	}
+}
+
+void bc_init(void) {
+	for (size_t i = 0; i <= BC_SIN_TABLE_SIZE; i++) {
+		sSinTable[i] = sinf(2.0f * (float) M_PI * i / BC_SIN_TABLE_SIZE);
+	}
+
+	sUpdateLock = xSemaphoreCreateMutex();
+	sSandboxDone = xSemaphoreCreateBinary();
+	gBytecode = sBytecodeAreas[sActiveArea];
+	sVm.bytecode = gBytecode;
+
+	esp_timer_create_args_t wakeArgs = {
+		.callback = &bc_wake,
+		.name = "bc_wake"
+	};
+	esp_timer_create(&wakeArgs, &sWakeTimer);
+
+	bc_update(gBytecodeEffects[0].bytecode, false, 0);
+	bc_activate();
+}
+
+void bc_start(void) {
+	xTaskCreatePinnedToCore(
+		&bc_task,
+		"bc_task",
+		BC_TASK_STACK_SIZE_BYTES,
+		NULL,
+		BC_TASK_PRIORITY,
+		&sBytecodeTask,
+		BC_TASK_CORE);
+
+	xTaskCreatePinnedToCore(
+		&bc_sandbox_task,
+		"bc_sandbox",
+		BC_SANDBOX_TASK_STACK_SIZE_BYTES,
+		NULL,
+		BC_SANDBOX_TASK_PRIORITY,
+		&sSandboxTask,
+		BC_SANDBOX_TASK_CORE);
+}
+
+// activateAt is in shared time, 0 to activate right away
+bool bc_update(uint8_t *bytecode, bool checkCrc, int64_t activateAt) {
+	size_t len = bc_len(bytecode);
+
+	if (checkCrc) {
+		uint8_t crc = bc_crc(bytecode, len);
+		if (bytecode[0] != crc) {
+			return false;
+		}
+	}
+
+	uint32_t hash = bc_hash(bytecode, len);
+
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	uint8_t *area = sBytecodeAreas[sActiveArea ^ 1];
+
+	if (sStreaming && sStreamArea == area) {
+		sStreamAborted = true;
+	}
+
+	memcpy(area, bytecode, len);
+	sPendingBytecode = area;
+	sPendingLen = len;
+	sPendingHash = hash;
+	sPending = true;
+	sPendingAt = activateAt;
+
+	xSemaphoreGive(sUpdateLock);
+
+	return true;
+}
+
+// Stages the error program, showing the message. Unlike bc_update it leaves
+// the inactive area alone, so an upload going on there carries on.
+static void bc_stage_error(const char *message) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	memcpy(sErrorBytecode.message, message, sizeof(sErrorBytecode.message));
+	sPendingBytecode = (uint8_t *) &sErrorBytecode;
+	sPendingLen = bc_len(sPendingBytecode);
+	sPendingHash = bc_hash(sPendingBytecode, sPendingLen);
+	sPending = true;
+	sPendingAt = 0;
+
+	xSemaphoreGive(sUpdateLock);
+}
+
+void bc_interrupt(void) {
+	sVm.cancel = true;
+	xTaskNotifyGive(sBytecodeTask);
+}
+
+static void bc_sandbox_run(void (*job)(void)) {
+	sSandboxJob = job;
+	xTaskNotifyGive(sSandboxTask);
+	xSemaphoreTake(sSandboxDone, portMAX_DELAY);
+}
+
+static void bc_scan_begin(struct ScanState *scan, struct BytecodeAnalysis *analysis) {
+	memset(scan, 0, sizeof(*scan));
+	scan->pc = 2;
+
+	analysis->memMin = -1;
+	analysis->memMax = -1;
+}
+
+// Decodes the whole instructions before `avail`. Until the end marker is in
+// (scan->len is 0), an instruction running past `avail` waits for more bytes.
+static bool bc_scan_step(const uint8_t *bytecode, size_t avail, struct ScanState *scan, struct BytecodeAnalysis *analysis) {
+	while (scan->pc < avail) {
+		size_t at = scan->pc;
+		uint8_t opcode = bytecode[at];
+		const char *operands = sOpOperands[opcode];
+
+		if (operands == NULL) {
+			snprintf(analysis->error, sizeof(analysis->error), "invalid opcode %02x at %04x", opcode, at);
+			return false;
+		}
+
+		size_t pc = at + 1;
+		for (const char *operand = operands; *operand != '\0'; operand++) {
+			pc += *operand == 'r' || *operand == 'x' ? 1 : 4;
+		}
+
+		if (pc > avail) {
+			if (scan->len == 0) {
+				break;
+			}
+
+			snprintf(analysis->error, sizeof(analysis->error), "truncated instruction at %04x", at);
+			return false;
+		}
+
+		pc = at + 1;
+		float imm = 0.0f;
+
+		for (const char *operand = operands; *operand != '\0'; operand++) {
+			size_t size = *operand == 'r' || *operand == 'x' ? 1 : 4;
+
+			switch (*operand) {
+				case 'r':
+					scan->regs[bytecode[pc] / 32] |= 1U << (bytecode[pc] % 32);
+					break;
+
+				case 'x':
+					scan->intRegs[bytecode[pc] / 32] |= 1U << (bytecode[pc] % 32);
+					break;
+
+				case 'f': {
+					union {
+						uint32_t i;
+						float f;
+					} cast = { .i = bc_load_u32(&bytecode[pc]) };
+
+					imm = cast.f;
+					break;
+				}
+
+				case 'a': {
+					uint32_t target = bc_load_u32(&bytecode[pc]);
+					if (scan->len != 0 && target >= scan->len) {
+						snprintf(analysis->error, sizeof(analysis->error), "jump target %04" PRIx32 " out of range at %04x", target, at);
+						return false;
+					}
+
+					// Checked against the length once it's known
+					if (target >= scan->maxTarget) {
+						scan->maxTarget = target;
+						scan->maxTargetAt = at;
+					}
+
+					if (target <= at) {
+						analysis->loops = true;
+					}
+					break;
+				}
+			}
+
+			pc += size;
+		}
+
+		scan->pc = pc;
+
+		if (sOps[opcode] == bc_op_loadi || sOps[opcode] == bc_op_storei) {
+			if (!(imm >= 0.0f && imm < BC_MEMORY_SIZE)) {
+				snprintf(analysis->error, sizeof(analysis->error), "memory address out of range at %04x", at);
+				return false;
+			}
+
+			int32_t addr = (int32_t) imm;
+			if (analysis->memMin < 0 || addr < analysis->memMin) {
+				analysis->memMin = addr;
+			}
+			if (addr > analysis->memMax) {
+				analysis->memMax = addr;
+			}
+		} else if (
+			sOps[opcode] == bc_op_loadr ||
+			sOps[opcode] == bc_op_storer ||
+			sOps[opcode] == bc_op_iloadr ||
+			sOps[opcode] == bc_op_istorer) {
+			analysis->memDynamic = true;
+		}
+
+		uint32_t opCost = 1;
+		for (size_t i = 0; i < sizeof(sOpClasses) / sizeof(sOpClasses[0]); i++) {
+			if (opcode >= sOpClasses[i].first && opcode <= sOpClasses[i].last) {
+				analysis->features |= sOpClasses[i].feature;
+				opCost = sOpClasses[i].cost;
+				break;
+			}
+		}
+
+		scan->cost += opCost;
+		analysis->instrs++;
+	}
+
+	return true;
+}
+
+static bool bc_scan_finish(struct ScanState *scan, struct BytecodeAnalysis *analysis) {
+	if (scan->maxTarget >= scan->len) {
+		snprintf(analysis->error, sizeof(analysis->error), "jump target %04" PRIx32 " out of range at %04x", scan->maxTarget, scan->maxTargetAt);
+		return false;
+	}
+
+	for (size_t i = 0; i < 256 / 32; i++) {
+		analysis->regs += __builtin_popcount(scan->regs[i]);
+		analysis->intRegs += __builtin_popcount(scan->intRegs[i]);
+	}
+
+	// Straight-line cost of a frame, loops make this a lower bound
+	analysis->cost = analysis->mode == BC_MODE_PER_LED ? scan->cost * STRIP_LED_COUNT : scan->cost;
+
+	return true;
+}
+
+// Decodes the program once front to back without running it. Anything that
+// would certainly fail at runtime is reported as an error.
+static bool bc_scan(uint8_t *bytecode, struct BytecodeAnalysis *analysis) {
+	size_t len = bc_len(bytecode);
+	struct ScanState scan;
+
+	bc_scan_begin(&scan, analysis);
+	scan.len = len;
+
+	analysis->len = len;
+	analysis->mode = bytecode[1];
+
+	if (bytecode[0] != bc_crc(bytecode, len)) {
+		snprintf(analysis->error, sizeof(analysis->error), "checksum verification fail");
+		return false;
+	}
+
+	if (analysis->mode != BC_MODE_PER_LED && analysis->mode != BC_MODE_PER_TICK) {
+		snprintf(analysis->error, sizeof(analysis->error), "invalid mode %02x", analysis->mode);
+		return false;
+	}
+
+	return bc_scan_step(bytecode, len - 8, &scan, analysis) && bc_scan_finish(&scan, analysis);
+}
+
+// Checks a candidate program without activating it, then hands it to the
+// sandbox task for a timed trial run and waits for the result
+bool bc_analyze(uint8_t *bytecode, struct BytecodeAnalysis *analysis) {
+	memset(analysis, 0, sizeof(*analysis));
+
+	if (!bc_scan(bytecode, analysis)) {
+		return false;
+	}
+
+	sTrialBytecode = bytecode;
+	sTrialAnalysis = analysis;
+	bc_sandbox_run(bc_trial_run);
+
+	return analysis->error[0] == '\0';
+}
+
+// Runs on the sandbox task, timing a copy of the active program alongside it
+bool bc_bench(void) {
+	bc_sandbox_run(bc_bench_run);
+
+	return gBytecodeBench.done;
+}
+
+// Uploads go straight into the inactive area and are checked as they arrive:
+// the checksum, the end marker and every instruction that's complete. There's
+// one upload at a time. While a program is waiting in the inactive area for
+// its start time, the upload goes to a buffer of its own instead, so the
+// waiting program is only dropped once the upload has checked out. Returns
+// false when there's no memory for that buffer.
+bool bc_stream_begin(struct BytecodeAnalysis *analysis, size_t len) {
+	memset(analysis, 0, sizeof(*analysis));
+
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	uint8_t *area = sBytecodeAreas[sActiveArea ^ 1];
+	bool held = sPending && sPendingBytecode == area;
+
+	sStreamMax = held && len + 8 < BC_MAX_LEN ? len + 8 : BC_MAX_LEN;
+	sStreamBuffer = held ? heap_caps_malloc(sStreamMax, MALLOC_CAP_8BIT) : NULL;
+	sStreamArea = held ? sStreamBuffer : area;
+	sStreaming = sStreamArea != NULL;
+	sStreamAborted = false;
+
+	xSemaphoreGive(sUpdateLock);
+
+	if (!sStreaming) {
+		snprintf(analysis->error, sizeof(analysis->error), "not enough memory for the upload");
+		return false;
+	}
+
+	sStreamReceived = 0;
+	sStreamLen = 0;
+	sStreamMarker = 0;
+	sStreamCrc = 0;
+	sStreamHash = 0x811C9DC5;
+	sStreamAnalysis = analysis;
+	bc_scan_begin(&sStreamScan, analysis);
+
+	return true;
+}
+
+// Takes one more byte of the upload, while holding sUpdateLock
+static bool bc_stream_put(uint8_t byte) {
+	struct BytecodeAnalysis *analysis = sStreamAnalysis;
+
+	if (sStreamReceived == sStreamMax) {
+		snprintf(analysis->error, sizeof(analysis->error), "missing end marker");
+		return false;
+	}
+
+	sStreamArea[sStreamReceived++] = byte;
+	sStreamHash = (sStreamHash ^ byte) * 0x01000193;
+
+	// Same as bc_crc, which skips the checksum byte itself
+	if (sStreamReceived > 1) {
+		sStreamCrc ^= byte;
+		for (uint32_t j = 0; j < 8; j++) {
+			sStreamCrc = sStreamCrc & 0x80 ? (sStreamCrc << 1) ^ 0x31 : sStreamCrc << 1;
+		}
+	}
+
+	if (sStreamReceived == 2) {
+		analysis->mode = byte;
+		if (byte != BC_MODE_PER_LED && byte != BC_MODE_PER_TICK) {
+			snprintf(analysis->error, sizeof(analysis->error), "invalid mode %02x", byte);
+			return false;
+		}
+	}
+
+	sStreamMarker = byte == 0xFF ? sStreamMarker + 1 : 0;
+	if (sStreamMarker == 8) {
+		sStreamLen = sStreamReceived;
+	}
+
+	return true;
+}
+
+// Anything after the end marker is ignored, like bc_len does
+static bool bc_stream_take(const uint8_t *data, size_t len) {
+	if (sStreamAborted) {
+		snprintf(sStreamAnalysis->error, sizeof(sStreamAnalysis->error), "interrupted by a program update");
+		return false;
+	}
+
+	for (size_t i = 0; i < len && sStreamLen == 0; i++) {
+		if (!bc_stream_put(data[i])) {
+			return false;
+		}
+	}
+
+	// Bytes in a run of 0xFF could still turn out to be the end marker
+	sStreamScan.len = sStreamLen;
+	size_t avail = sStreamLen != 0 ? sStreamLen - 8 : sStreamReceived - sStreamMarker;
+
+	return bc_scan_step(sStreamArea, avail, &sStreamScan, sStreamAnalysis);
+}
+
+bool bc_stream_write(const uint8_t *data, size_t len) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+	bool ok = bc_stream_take(data, len);
+	xSemaphoreGive(sUpdateLock);
+
+	return ok;
+}
+
+// Finishes checking the upload. An upload without an end marker gets one.
+// `bytecode` is where the upload is, which stays put until it's staged or
+// the stream is closed.
+bool bc_stream_end(uint8_t **bytecode) {
+	struct BytecodeAnalysis *analysis = sStreamAnalysis;
+	static const uint8_t marker[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	bool ok = bc_stream_take(marker, sStreamLen == 0 ? 8 - sStreamMarker : 0);
+
+	if (ok) {
+		analysis->len = sStreamLen;
+
+		if (sStreamArea[0] != sStreamCrc) {
+			snprintf(analysis->error, sizeof(analysis->error), "checksum verification fail");
+			ok = false;
+		} else {
+			ok = bc_scan_finish(&sStreamScan, analysis);
+		}
+	}
+
+	*bytecode = sStreamArea;
+
+	xSemaphoreGive(sUpdateLock);
+
+	return ok;
+}
+
+// Stages a checked upload to take over like bc_update, then closes the
+// stream. `bytecode` is where the staged program is, for saving it.
+bool bc_stream_stage(int64_t activateAt, const uint8_t **bytecode) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	bool ok = !sStreamAborted;
+
+	if (ok) {
+		uint8_t *area = sBytecodeAreas[sActiveArea ^ 1];
+		if (sStreamArea != area) {
+			memcpy(area, sStreamArea, sStreamLen);
+		}
+
+		sPendingBytecode = area;
+		sPendingLen = sStreamLen;
+		sPendingHash = sStreamHash;
+		sPending = true;
+		sPendingAt = activateAt;
+		*bytecode = area;
+	} else {
+		snprintf(sStreamAnalysis->error, sizeof(sStreamAnalysis->error), "interrupted by a program update");
+	}
+
+	xSemaphoreGive(sUpdateLock);
+
+	bc_stream_close();
+	return ok;
+}
+
+// Ends the upload without staging it. Whatever it left in the inactive area
+// never runs.
+void bc_stream_close(void) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+	sStreaming = false;
+	xSemaphoreGive(sUpdateLock);
+
+	heap_caps_free(sStreamBuffer);
+	sStreamBuffer = NULL;
+}
+
+// Stages a program for one of the layers, or clears it when bytecode is NULL.
+// It takes over from the next frame on, starting from tick 0. Layers can't
+// read the previous frame, as they don't have one of their own.
+bool bc_layer_update(size_t index, uint8_t *bytecode, const struct BytecodeLayer *layer, struct BytecodeAnalysis *analysis) {
+	memset(analysis, 0, sizeof(*analysis));
+
+	if (index >= BC_MAX_LAYERS) {
+		snprintf(analysis->error, sizeof(analysis->error), "layer out of range (%d)", index);
+		return false;
+	}
+
+	if (bytecode != NULL) {
+		if (!bc_scan(bytecode, analysis)) {
+			return false;
+		}
+
+		if (analysis->len > BC_LAYER_MAX_LEN) {
+			snprintf(analysis->error, sizeof(analysis->error), "layer programs are limited to %d bytes", BC_LAYER_MAX_LEN);
+			return false;
+		}
+
+		if (analysis->features & BC_FEATURE_PREV_FRAME) {
+			snprintf(analysis->error, sizeof(analysis->error), "layers can't read the previous frame");
+			return false;
+		}
+
+		if (layer->count == 0 || layer->start >= STRIP_LED_COUNT || layer->count > STRIP_LED_COUNT - layer->start) {
+			snprintf(analysis->error, sizeof(analysis->error), "led range outside the strip (position %d, count %d)", layer->start, layer->count);
+			return false;
+		}
+
+		if (layer->blend >= BC_BLEND_COUNT) {
+			snprintf(analysis->error, sizeof(analysis->error), "unknown blend mode (%d)", layer->blend);
+			return false;
+		}
+	}
+
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+
+	if (bytecode != NULL) {
+		memcpy(sLayerAreas[index][sLayerActiveArea[index] ^ 1], bytecode, analysis->len);
+		sPendingLayers[index] = *layer;
+		sPendingLayers[index].len = analysis->len;
+	} else {
+		sPendingLayers[index] = (struct BytecodeLayer) { 0 };
+	}
+
+	sLayerPending[index] = true;
+
+	xSemaphoreGive(sUpdateLock);
+
+	return true;
+}
+
+// What the layer will render next frame
+void bc_layer_get(size_t index, struct BytecodeLayer *layer) {
+	xSemaphoreTake(sUpdateLock, portMAX_DELAY);
+	*layer = sLayerPending[index] ? sPendingLayers[index] : sLayers[index];
+	xSemaphoreGive(sUpdateLock);
+}
+
+// Runs a program for a number of ticks back to back on the calling task, and
+// hands each frame to `frame` packed as the strip would be sent it. Stock
+// effects run natively unless native is false. Nothing
+// waits out the period, so this is for offline rendering on the host, where
+// bc_task isn't running.
+bool bc_render(uint8_t *bytecode, uint32_t frames, bool native, void (*frame)(const uint8_t (*data)[3], void *arg), void *arg, struct BytecodeRender *render) {
+	static uint8_t packed[STRIP_LED_COUNT][3];
+	static struct BytecodeAnalysis analysis;
+
+	memset(render, 0, sizeof(*render));
+	memset(&analysis, 0, sizeof(analysis));
+
+	if (!bc_scan(bytecode, &analysis)) {
+		snprintf(render->error, sizeof(render->error), "%s", analysis.error);
+		return false;
+	}
+
+	struct BytecodeSandbox *sandbox = bc_sandbox_new(bytecode, analysis.len, native);
+	if (sandbox == NULL) {
+		snprintf(render->error, sizeof(render->error), "not enough memory to render");
+		return false;
+	}
+
+	// Straight to the strip, for strip_pack
+	struct BytecodeVm *vm = &sandbox->vm;
+	vm->strip = gStripData;
+	vm->stripMode = &gStripMode;
+	vm->stripInterpolate = &gStripInterpolate;
+
+	while (render->frames < frames) {
+		layout_activate();
+		strip_reset();
+		vm->frameInstrs = 0;
+
+		int64_t start = esp_timer_get_time();
+
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+
+		if (vm->error) {
+			vm->error = false;
+			snprintf(render->error, sizeof(render->error), "tick %" PRIu32 ": %.200s", vm->ticks, vm->message);
+			break;
+		}
+
+		render->renderUs += esp_timer_get_time() - start;
+		render->instrs += vm->frameInstrs;
+		render->frames++;
+
+		memcpy(vm->prevStrip, vm->strip, sizeof(vm->prevStrip));
+		strip_pack(packed);
+		frame(packed, arg);
+
+		vm->ticks++;
+	}
+
+	render->periodMs = vm->periodMs;
+
+	heap_caps_free(sandbox);
+	return render->error[0] == '\0';
+}
@@ -4,14 +4,57 @@
 #define BC_MAX_INSTRS 100000
 #define BC_ERR_PATTERN_SIZE 18
 #define BC_MEMORY_SIZE 0x1000
+#define BC_LED_STATE_SLOTS 8
+#define BC_CANCEL_CHECK_INTERVAL 0x100
+#define BC_NOISE_FRAC_BITS 12
+#define BC_NOISE_MAX_OCTAVES 8
+#define BC_PALETTE_COUNT 8
+#define BC_PALETTE_SIZE 256
+#define BC_SIN_TABLE_SIZE 256
+#define BC_CACHE_INTERNAL_SIZE 0x8000
+#define BC_CACHE_MAX_PERIOD 0x1000
+#define BC_CACHE_FLAG_VALID 0x01
+#define BC_CACHE_FLAG_INTERPOLATE 0x02
+#define BC_TRIAL_FRAMES 4
+#define BC_TRIAL_BUDGET_US 200000
+#define BC_BENCH_COPIES 32
+#define BC_BENCH_RUNS 8
+#define BC_BENCH_BYTECODE_LEN 0x400
+#define BC_MAX_LAYERS 3
+#define BC_LAYER_MAX_LEN 0x1000
+#define BC_EFFECT_COUNT 4
 
 #define BC_MODE_PER_LED 0
 #define BC_MODE_PER_TICK 1
 
+#define BC_BLEND_REPLACE 0
+#define BC_BLEND_ADD 1
+#define BC_BLEND_ALPHA 2
+#define BC_BLEND_MAX 3
+#define BC_BLEND_COUNT 4
+
+#define BC_FEATURE_RANDOM 0x0001
+#define BC_FEATURE_TRIG 0x0002
+#define BC_FEATURE_MEMORY 0x0004
+#define BC_FEATURE_LED_STATE 0x0008
+#define BC_FEATURE_NOISE 0x0010
+#define BC_FEATURE_PALETTE 0x0020
+#define BC_FEATURE_FAST_MATH 0x0040
+#define BC_FEATURE_LAYOUT 0x0080
+#define BC_FEATURE_FRAMEBUFFER 0x0100
+#define BC_FEATURE_PREV_FRAME 0x0200
+#define BC_FEATURE_RENDER_CONFIG 0x0400
+#define BC_FEATURE_INTEGER 0x0800
+#define BC_FEATURE_COUNT 12
+
 #define BC_TASK_STACK_SIZE_BYTES 0x4000
 #define BC_TASK_PRIORITY (configMAX_PRIORITIES - 1)
 #define BC_TASK_CORE 0
 
+#define BC_SANDBOX_TASK_STACK_SIZE_BYTES 0x4000
+#define BC_SANDBOX_TASK_PRIORITY 1
+#define BC_SANDBOX_TASK_CORE 1
+
 struct ErrorBytecode {
 	uint8_t crc;
 	uint8_t mode;
@@ -20,15 +63,118 @@ struct ErrorBytecode {
 	uint8_t end[8];
 };
 
+struct BytecodeStats {
+	uint32_t frames;
+	uint32_t cancelledFrames;
+	uint32_t errors;
+	uint32_t ledEvals;
+	uint32_t ledEvalsSkipped;
+	uint32_t cachedFrames;
+	uint32_t cacheFailures;
+};
+
+struct BytecodeAnalysis {
+	// Static scan
+	size_t len;
+	uint8_t mode;
+	uint32_t instrs;
+	uint32_t regs;
+	uint32_t intRegs;
+	int32_t memMin;
+	int32_t memMax;
+	bool memDynamic;
+	bool loops;
+	uint32_t features;
+	uint32_t cost;
+
+	// Trial run
+	uint32_t frames;
+	bool timedOut;
+	uint32_t renderUs;
+	uint32_t maxRenderUs;
+	uint32_t instrsPerFrame;
+	uint32_t periodMs;
+	uint32_t tickPeriod;
+	bool cacheFits;
+	float fps;
+
+	char error[256];
+};
+
+struct BytecodeBenchEffect {
+	uint32_t interpretedCycles;
+	uint32_t nativeCycles;
+};
+
+struct BytecodeBenchOp {
+	bool measured;
+	float total;
+	float decode;
+	float body;
+};
+
+// Costs in CPU cycles, except for refreshUs
+struct BytecodeBench {
+	bool done;
+	uint32_t cpuMhz;
+	float dispatch;
+	float decodeU8;
+	float decodeU32;
+	struct BytecodeBenchOp ops[256];
+	uint32_t renderCycles;
+	uint32_t packCycles;
+	uint32_t refreshUs;
+	struct BytecodeBenchEffect effects[BC_EFFECT_COUNT];
+};
+
+// A program rendered over its own LED range on top of the active one. len is
+// 0 while the layer is empty.
+struct BytecodeLayer {
+	size_t len;
+	uint16_t start;
+	uint16_t count;
+	uint8_t blend;
+	uint8_t opacity;
+};
+
+struct BytecodeRender {
+	uint32_t frames;
+	uint64_t instrs;
+	uint64_t renderUs;
+	uint32_t periodMs;
+	char error[256];
+};
+
+// A stock program, run as native code while it's active unchanged
+struct BytecodeEffect {
+	const char *name;
+	uint8_t *bytecode;
+	size_t len;
+};
+
 struct BytecodeOp {
 	uint32_t arity;
 	void (*func)(uint8_t *args);
 };
 
-extern uint8_t gBytecode[BC_MAX_LEN];
+extern uint8_t *gBytecode;
 extern size_t gBytecodeLen;
+extern struct BytecodeStats gBytecodeStats;
+extern struct BytecodeBench gBytecodeBench;
+extern const char *gBytecodeOpNames[256];
+extern const struct BytecodeEffect gBytecodeEffects[BC_EFFECT_COUNT];
 
 extern void bc_init(void);
 extern void bc_start(void);
-extern bool bc_update(uint8_t *bytecode, bool checkCrc);
+extern bool bc_update(uint8_t *bytecode, bool checkCrc, int64_t activateAt);
+extern bool bc_stream_begin(struct BytecodeAnalysis *analysis, size_t len);
+extern bool bc_stream_write(const uint8_t *data, size_t len);
+extern bool bc_stream_end(uint8_t **bytecode);
+extern bool bc_stream_stage(int64_t activateAt, const uint8_t **bytecode);
+extern void bc_stream_close(void);
 extern void bc_interrupt(void);
+extern bool bc_analyze(uint8_t *bytecode, struct BytecodeAnalysis *analysis);
+extern bool bc_bench(void);
+extern bool bc_layer_update(size_t index, uint8_t *bytecode, const struct BytecodeLayer *layer, struct BytecodeAnalysis *analysis);
+extern void bc_layer_get(size_t index, struct BytecodeLayer *layer);
+extern bool bc_render(uint8_t *bytecode, uint32_t frames, bool native, void (*frame)(const uint8_t (*data)[3], void *arg), void *arg, struct BytecodeRender *render);
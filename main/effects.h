@@ -0,0 +1,87 @@
+// Stock effects, selectable by ID in the order they're listed here. This is
+// included by bytecode.c and by tools/aot, which translates each one to C
+// for effects_native.h. Regenerate that after changing anything here.
+
+EFFECT(stripes,
+	/* checksum */ 0x35,
+	/* mode */ BC_MODE_PER_LED,
+	/* 02: periodici 12.0f */ 0x92, 0x41, 0x40, 0x00, 0x00,
+	/* 07: hsv             */ 0x02,
+	/* 08: periodi 100.0f  */ 0x03, 0x42, 0xC8, 0x00, 0x00,
+	/* 0D: vali 150.0f     */ 0x07, 0x43, 0x16, 0x00, 0x00,
+	/* 12: getposend r0    */ 0x0C, 0x00,
+	/* 14: getticks r1     */ 0x0D, 0x01,
+	/* 16: addr r0 r0 r1   */ 0x13, 0x00, 0x00, 0x01,
+	/* 1A: divi r0 r0 3.0f */ 0x17, 0x00, 0x00, 0x40, 0x40, 0x00, 0x00,
+	/* 21: modi r0 r0 4.0f */ 0x19, 0x00, 0x00, 0x40, 0x80, 0x00, 0x00,
+	/* 28: cz r0           */ 0x41, 0x00,
+	/* 2A: haltt           */ 0x33,
+	/* 2B: huei 348.0f     */ 0x05, 0x43, 0xAE, 0x00, 0x00,
+	/* 30: sati 79.0f      */ 0x06, 0x42, 0x9E, 0x00, 0x00,
+	/* 35: modi r1 r0 2.0f */ 0x19, 0x01, 0x00, 0x40, 0x00, 0x00, 0x00,
+	/* 3C: cnz r1          */ 0x42, 0x01,
+	/* 3E: haltt           */ 0x33,
+	/* 3F: huei 197.0f     */ 0x05, 0x43, 0x45, 0x00, 0x00,
+	/* 44: sati 162.0f     */ 0x06, 0x43, 0x22, 0x00, 0x00,
+	/* end */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF)
+
+EFFECT(rainbow,
+	/* checksum */ 0xCA,
+	/* mode */ BC_MODE_PER_LED,
+	/* 02: periodici 36.0f   */ 0x92, 0x42, 0x10, 0x00, 0x00,
+	/* 07: hsv               */ 0x02,
+	/* 08: periodi 50.0f     */ 0x03, 0x42, 0x48, 0x00, 0x00,
+	/* 0D: sati 255.0f       */ 0x06, 0x43, 0x7F, 0x00, 0x00,
+	/* 12: vali 120.0f       */ 0x07, 0x42, 0xF0, 0x00, 0x00,
+	/* 17: getpos r0         */ 0x0B, 0x00,
+	/* 19: muli r0 r0 3.0f   */ 0x15, 0x00, 0x00, 0x40, 0x40, 0x00, 0x00,
+	/* 20: getticks r1       */ 0x0D, 0x01,
+	/* 22: muli r1 r1 10.0f  */ 0x15, 0x01, 0x01, 0x41, 0x20, 0x00, 0x00,
+	/* 29: addr r0 r0 r1     */ 0x13, 0x00, 0x00, 0x01,
+	/* 2D: remi r0 r0 360.0f */ 0x1B, 0x00, 0x00, 0x43, 0xB4, 0x00, 0x00,
+	/* 34: huer r0           */ 0x08, 0x00,
+	/* end */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF)
+
+EFFECT(fire,
+	/* checksum */ 0x2C,
+	/* mode */ BC_MODE_PER_LED,
+	/* 02: hsv                      */ 0x02,
+	/* 03: periodi 40.0f            */ 0x03, 0x42, 0x20, 0x00, 0x00,
+	/* 08: sati 255.0f              */ 0x06, 0x43, 0x7F, 0x00, 0x00,
+	/* 0D: getpos r0                */ 0x0B, 0x00,
+	/* 0F: muli r0 r0 0.15f         */ 0x15, 0x00, 0x00, 0x3E, 0x19, 0x99, 0x9A,
+	/* 16: getticks r1              */ 0x0D, 0x01,
+	/* 18: muli r1 r1 0.08f         */ 0x15, 0x01, 0x01, 0x3D, 0xA3, 0xD7, 0x0A,
+	/* 1F: noise2r r2 r0 r1         */ 0x61, 0x02, 0x00, 0x01,
+	/* 23: addi r2 r2 1.0f          */ 0x12, 0x02, 0x02, 0x3F, 0x80, 0x00, 0x00,
+	/* 2A: muli r3 r2 20.0f         */ 0x15, 0x03, 0x02, 0x41, 0xA0, 0x00, 0x00,
+	/* 31: clampi r3 r3 0.0f 40.0f  */ 0x2C, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x42, 0x20, 0x00, 0x00,
+	/* 3C: huer r3                  */ 0x08, 0x03,
+	/* 3E: muli r4 r2 110.0f        */ 0x15, 0x04, 0x02, 0x42, 0xDC, 0x00, 0x00,
+	/* 45: addi r4 r4 30.0f         */ 0x12, 0x04, 0x04, 0x41, 0xF0, 0x00, 0x00,
+	/* 4C: clampi r4 r4 0.0f 255.0f */ 0x2C, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x43, 0x7F, 0x00, 0x00,
+	/* 57: valr r4                  */ 0x0A, 0x04,
+	/* end */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF)
+
+EFFECT(chase,
+	/* checksum */ 0x89,
+	/* mode */ BC_MODE_PER_TICK,
+	/* 02: rgb              */ 0x01,
+	/* 03: periodi 30.0f    */ 0x03, 0x41, 0xF0, 0x00, 0x00,
+	/* 08: getnumleds r1    */ 0x0F, 0x01,
+	/* 0A: getticks r0      */ 0x0D, 0x00,
+	/* 0C: remr r0 r0 r1    */ 0x1C, 0x00, 0x00, 0x01,
+	/* 10: movi r2 0.0f     */ 0x10, 0x02, 0x00, 0x00, 0x00, 0x00,
+	/* 16: subr r3 r0 r2    */ 0x14, 0x03, 0x00, 0x02,
+	/* 1A: remr r3 r3 r1    */ 0x1C, 0x03, 0x03, 0x01,
+	/* 1E: posr r3          */ 0x81, 0x03,
+	/* 20: movi r4 8.0f     */ 0x10, 0x04, 0x41, 0x00, 0x00, 0x00,
+	/* 26: subr r4 r4 r2    */ 0x14, 0x04, 0x04, 0x02,
+	/* 2A: muli r4 r4 31.0f */ 0x15, 0x04, 0x04, 0x41, 0xF8, 0x00, 0x00,
+	/* 31: redr r4          */ 0x08, 0x04,
+	/* 33: muli r5 r4 0.4f  */ 0x15, 0x05, 0x04, 0x3E, 0xCC, 0xCC, 0xCD,
+	/* 3A: greenr r5        */ 0x09, 0x05,
+	/* 3C: addi r2 r2 1.0f  */ 0x12, 0x02, 0x02, 0x3F, 0x80, 0x00, 0x00,
+	/* 43: clti r2 8.0f     */ 0x45, 0x02, 0x41, 0x00, 0x00, 0x00,
+	/* 49: jt 16            */ 0x31, 0x00, 0x00, 0x00, 0x16,
+	/* end */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF)
@@ -0,0 +1,274 @@
+// Generated by tools/aot from effects.h, don't edit. Native versions of
+// the stock effects, each the same as interpreting its bytecode.
+
+// stripes, 81 bytes, hash F8BCA8B0
+static void bc_native_stripes(struct BytecodeVm *vm) {
+	vm->registers[0] = 0.0f;
+	vm->registers[1] = 0.0f;
+
+	// 02: periodici 12.0f
+	vm->pc = 0x03;
+	bc_op_periodici(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 07: hsv
+	*vm->stripMode = STRIP_MODE_HSV;
+
+	// 08: periodi 100.0f
+	vm->periodMs = (uint32_t) 100.0f;
+
+	// 0D: bluei 150.0f
+	vm->strip[vm->curLed][2] = (uint32_t) 150.0f;
+
+	// 12: getposend r0
+	vm->registers[0] = (float) (vm->ledStart + vm->ledCount - vm->curLed);
+
+	// 14: getticks r1
+	vm->registers[1] = (float) bc_ticks(vm);
+
+	// 16: addr r0 r0 r1
+	vm->registers[0] = vm->registers[0] + vm->registers[1];
+
+	// 1A: divi r0 r0 3.0f
+	vm->registers[0] = vm->registers[0] / 3.0f;
+
+	// 21: modi r0 r0 4.0f
+	vm->registers[0] = (float) ((int32_t) vm->registers[0] % (int32_t) 4.0f);
+
+	// 28: cz r0
+	vm->compare = vm->registers[0] == 0.0f;
+
+	// 2A: haltt
+	vm->instrs += 11;
+	if (vm->compare) {
+		return;
+	}
+
+	// 2B: redi 348.0f
+	vm->strip[vm->curLed][0] = (uint32_t) 348.0f;
+
+	// 30: greeni 79.0f
+	vm->strip[vm->curLed][1] = (uint32_t) 79.0f;
+
+	// 35: modi r1 r0 2.0f
+	vm->registers[1] = (float) ((int32_t) vm->registers[0] % (int32_t) 2.0f);
+
+	// 3C: cnz r1
+	vm->compare = vm->registers[1] != 0.0f;
+
+	// 3E: haltt
+	vm->instrs += 5;
+	if (vm->compare) {
+		return;
+	}
+
+	// 3F: redi 197.0f
+	vm->strip[vm->curLed][0] = (uint32_t) 197.0f;
+
+	// 44: greeni 162.0f
+	vm->strip[vm->curLed][1] = (uint32_t) 162.0f;
+	vm->instrs += 3;
+}
+
+// rainbow, 62 bytes, hash 25FD8E3B
+static void bc_native_rainbow(struct BytecodeVm *vm) {
+	vm->registers[0] = 0.0f;
+	vm->registers[1] = 0.0f;
+
+	// 02: periodici 36.0f
+	vm->pc = 0x03;
+	bc_op_periodici(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 07: hsv
+	*vm->stripMode = STRIP_MODE_HSV;
+
+	// 08: periodi 50.0f
+	vm->periodMs = (uint32_t) 50.0f;
+
+	// 0D: greeni 255.0f
+	vm->strip[vm->curLed][1] = (uint32_t) 255.0f;
+
+	// 12: bluei 120.0f
+	vm->strip[vm->curLed][2] = (uint32_t) 120.0f;
+
+	// 17: getpos r0
+	vm->registers[0] = (float) (vm->curLed - vm->ledStart);
+
+	// 19: muli r0 r0 3.0f
+	vm->registers[0] = vm->registers[0] * 3.0f;
+
+	// 20: getticks r1
+	vm->registers[1] = (float) bc_ticks(vm);
+
+	// 22: muli r1 r1 10.0f
+	vm->registers[1] = vm->registers[1] * 10.0f;
+
+	// 29: addr r0 r0 r1
+	vm->registers[0] = vm->registers[0] + vm->registers[1];
+
+	// 2D: remi r0 r0 360.0f
+	vm->registers[0] = (float) (((int32_t) vm->registers[0] % (int32_t) 360.0f + (int32_t) 360.0f) % (int32_t) 360.0f);
+
+	// 34: redr r0
+	vm->strip[vm->curLed][0] = (uint32_t) vm->registers[0];
+	vm->instrs += 13;
+}
+
+// fire, 97 bytes, hash 39FD431F
+static void bc_native_fire(struct BytecodeVm *vm) {
+	vm->registers[0] = 0.0f;
+	vm->registers[1] = 0.0f;
+	vm->registers[2] = 0.0f;
+	vm->registers[3] = 0.0f;
+	vm->registers[4] = 0.0f;
+
+	// 02: hsv
+	*vm->stripMode = STRIP_MODE_HSV;
+
+	// 03: periodi 40.0f
+	vm->periodMs = (uint32_t) 40.0f;
+
+	// 08: greeni 255.0f
+	vm->strip[vm->curLed][1] = (uint32_t) 255.0f;
+
+	// 0D: getpos r0
+	vm->registers[0] = (float) (vm->curLed - vm->ledStart);
+
+	// 0F: muli r0 r0 0.150000006f
+	vm->registers[0] = vm->registers[0] * 0.150000006f;
+
+	// 16: getticks r1
+	vm->registers[1] = (float) bc_ticks(vm);
+
+	// 18: muli r1 r1 0.0799999982f
+	vm->registers[1] = vm->registers[1] * 0.0799999982f;
+
+	// 1F: noise2r r2 r0 r1
+	vm->pc = 0x20;
+	bc_op_noise2r(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 23: addi r2 r2 1.0f
+	vm->registers[2] = vm->registers[2] + 1.0f;
+
+	// 2A: muli r3 r2 20.0f
+	vm->registers[3] = vm->registers[2] * 20.0f;
+
+	// 31: clampi r3 r3 0.0f 40.0f
+	vm->registers[3] = vm->registers[3] < 0.0f ? 0.0f : vm->registers[3] > 40.0f ? 40.0f : vm->registers[3];
+
+	// 3C: redr r3
+	vm->strip[vm->curLed][0] = (uint32_t) vm->registers[3];
+
+	// 3E: muli r4 r2 110.0f
+	vm->registers[4] = vm->registers[2] * 110.0f;
+
+	// 45: addi r4 r4 30.0f
+	vm->registers[4] = vm->registers[4] + 30.0f;
+
+	// 4C: clampi r4 r4 0.0f 255.0f
+	vm->registers[4] = vm->registers[4] < 0.0f ? 0.0f : vm->registers[4] > 255.0f ? 255.0f : vm->registers[4];
+
+	// 57: bluer r4
+	vm->strip[vm->curLed][2] = (uint32_t) vm->registers[4];
+	vm->instrs += 17;
+}
+
+// chase, 86 bytes, hash F7166B9C
+static void bc_native_chase(struct BytecodeVm *vm) {
+	vm->registers[0] = 0.0f;
+	vm->registers[1] = 0.0f;
+	vm->registers[2] = 0.0f;
+	vm->registers[3] = 0.0f;
+	vm->registers[4] = 0.0f;
+	vm->registers[5] = 0.0f;
+
+	// 02: rgb
+	*vm->stripMode = STRIP_MODE_RGB;
+
+	// 03: periodi 30.0f
+	vm->periodMs = (uint32_t) 30.0f;
+
+	// 08: getnumleds r1
+	vm->registers[1] = vm->ledCount;
+
+	// 0A: getticks r0
+	vm->registers[0] = (float) bc_ticks(vm);
+
+	// 0C: remr r0 r0 r1
+	vm->pc = 0x0D;
+	bc_op_remr(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 10: movi r2 0.0f
+	vm->registers[2] = 0.0f;
+	vm->instrs += 6;
+
+L0016:
+	// 16: subr r3 r0 r2
+	vm->registers[3] = vm->registers[0] - vm->registers[2];
+
+	// 1A: remr r3 r3 r1
+	vm->pc = 0x1B;
+	bc_op_remr(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 1E: posr r3
+	vm->pc = 0x1F;
+	bc_op_posr(vm);
+	if (!vm->running) {
+		return;
+	}
+
+	// 20: movi r4 8.0f
+	vm->registers[4] = 8.0f;
+
+	// 26: subr r4 r4 r2
+	vm->registers[4] = vm->registers[4] - vm->registers[2];
+
+	// 2A: muli r4 r4 31.0f
+	vm->registers[4] = vm->registers[4] * 31.0f;
+
+	// 31: redr r4
+	vm->strip[vm->curLed][0] = (uint32_t) vm->registers[4];
+
+	// 33: muli r5 r4 0.400000006f
+	vm->registers[5] = vm->registers[4] * 0.400000006f;
+
+	// 3A: greenr r5
+	vm->strip[vm->curLed][1] = (uint32_t) vm->registers[5];
+
+	// 3C: addi r2 r2 1.0f
+	vm->registers[2] = vm->registers[2] + 1.0f;
+
+	// 43: clti r2 8.0f
+	vm->compare = vm->registers[2] < 8.0f;
+
+	// 49: jt 16
+	vm->instrs += 12;
+	if (vm->compare) {
+		if (bc_native_yield(vm)) {
+			return;
+		}
+		goto L0016;
+	}
+	vm->instrs += 1;
+}
+
+static const struct NativeEffect sNativeEffects[BC_EFFECT_COUNT] = {
+	{ 0xF8BCA8B0, bc_native_stripes },
+	{ 0x25FD8E3B, bc_native_rainbow },
+	{ 0x39FD431F, bc_native_fire },
+	{ 0xF7166B9C, bc_native_chase }
+};
@@ -1,62 +1,62 @@
-OP(0x00, nop)
-OP(0x01, rgb)
-OP(0x02, hsv)
-OP(0x03, periodi)
-OP(0x04, periodr)
-OP(0x05, redi)
+OP(0x00, nop, "")
+OP(0x01, rgb, "")
+OP(0x02, hsv, "")
+OP(0x03, periodi, "f")
+OP(0x04, periodr, "r")
+OP(0x05, redi, "f")
 OP_ALIAS(0x05, huei)
-OP(0x06, greeni)
+OP(0x06, greeni, "f")
 OP_ALIAS(0x06, sati)
-OP(0x07, bluei)
+OP(0x07, bluei, "f")
 OP_ALIAS(0x07, vali)
-OP(0x08, redr)
+OP(0x08, redr, "r")
 OP_ALIAS(0x08, huer)
-OP(0x09, greenr)
+OP(0x09, greenr, "r")
 OP_ALIAS(0x09, satr)
-OP(0x0A, bluer)
+OP(0x0A, bluer, "r")
 OP_ALIAS(0x0A, valr)
-OP(0x0B, getpos)
-OP(0x0C, getposend)
-OP(0x0D, getticks)
-OP(0x0E, getrng)
-OP(0x0F, getnumleds)
-OP(0x10, movi)
-OP(0x11, movr)
-OP(0x12, addi)
-OP(0x13, addr)
-OP(0x14, subr)
-OP(0x15, muli)
-OP(0x16, mulr)
-OP(0x17, divi)
-OP(0x18, divr)
-OP(0x19, modi)
-OP(0x1A, modr)
-OP(0x1B, remi)
-OP(0x1C, remr)
-OP(0x1D, sinr)
-OP(0x1E, cosr)
-OP(0x1F, tanr)
-OP(0x20, asinr)
-OP(0x21, acosr)
-OP(0x22, atanr)
-OP(0x23, atan2r)
-OP(0x24, sqrtr)
-OP(0x25, floorr)
-OP(0x26, ceilr)
-OP(0x27, roundr)
-OP(0x28, mini)
-OP(0x29, minr)
-OP(0x2A, maxi)
-OP(0x2B, maxr)
-OP(0x2C, clampi)
-OP(0x2D, absr)
+OP(0x0B, getpos, "r")
+OP(0x0C, getposend, "r")
+OP(0x0D, getticks, "r")
+OP(0x0E, getrng, "r")
+OP(0x0F, getnumleds, "r")
+OP(0x10, movi, "rf")
+OP(0x11, movr, "rr")
+OP(0x12, addi, "rrf")
+OP(0x13, addr, "rrr")
+OP(0x14, subr, "rrr")
+OP(0x15, muli, "rrf")
+OP(0x16, mulr, "rrr")
+OP(0x17, divi, "rrf")
+OP(0x18, divr, "rrr")
+OP(0x19, modi, "rrf")
+OP(0x1A, modr, "rrr")
+OP(0x1B, remi, "rrf")
+OP(0x1C, remr, "rrr")
+OP(0x1D, sinr, "rr")
+OP(0x1E, cosr, "rr")
+OP(0x1F, tanr, "rr")
+OP(0x20, asinr, "rr")
+OP(0x21, acosr, "rr")
+OP(0x22, atanr, "rr")
+OP(0x23, atan2r, "rrr")
+OP(0x24, sqrtr, "rr")
+OP(0x25, floorr, "rr")
+OP(0x26, ceilr, "rr")
+OP(0x27, roundr, "rr")
+OP(0x28, mini, "rrf")
+OP(0x29, minr, "rrr")
+OP(0x2A, maxi, "rrf")
+OP(0x2B, maxr, "rrr")
+OP(0x2C, clampi, "rrff")
+OP(0x2D, absr, "rr")
 OP_NONE(0x2E)
 OP_NONE(0x2F)
-OP(0x30, goto)
-OP(0x31, jt)
-OP(0x32, jf)
-OP(0x33, haltt)
-OP(0x34, haltf)
+OP(0x30, goto, "a")
+OP(0x31, jt, "a")
+OP(0x32, jf, "a")
+OP(0x33, haltt, "")
+OP(0x34, haltf, "")
 OP_NONE(0x35)
 OP_NONE(0x36)
 OP_NONE(0x37)
@@ -68,31 +68,31 @@ OP_NONE(0x3C)
 OP_NONE(0x3D)
 OP_NONE(0x3E)
 OP_NONE(0x3F)
-OP(0x40, getcmp)
-OP(0x41, cz)
+OP(0x40, getcmp, "r")
+OP(0x41, cz, "r")
 OP_ALIAS(0x41, cnot)
-OP(0x42, cnz)
-OP(0x43, ceqi)
-OP(0x44, ceqr)
-OP(0x45, clti)
-OP(0x46, cltr)
-OP(0x47, clei)
-OP(0x48, cler)
-OP(0x49, cgti)
-OP(0x4A, cgtr)
-OP(0x4B, cgei)
-OP(0x4C, cger)
+OP(0x42, cnz, "r")
+OP(0x43, ceqi, "rf")
+OP(0x44, ceqr, "rr")
+OP(0x45, clti, "rf")
+OP(0x46, cltr, "rr")
+OP(0x47, clei, "rf")
+OP(0x48, cler, "rr")
+OP(0x49, cgti, "rf")
+OP(0x4A, cgtr, "rr")
+OP(0x4B, cgei, "rf")
+OP(0x4C, cger, "rr")
 OP_NONE(0x4D)
 OP_NONE(0x4E)
 OP_NONE(0x4F)
-OP(0x50, loadi)
-OP(0x51, loadr)
-OP(0x52, storei)
-OP(0x53, storer)
-OP_NONE(0x54)
-OP_NONE(0x55)
-OP_NONE(0x56)
-OP_NONE(0x57)
+OP(0x50, loadi, "rf")
+OP(0x51, loadr, "rr")
+OP(0x52, storei, "rf")
+OP(0x53, storer, "rr")
+OP(0x54, sloadi, "rf")
+OP(0x55, sloadr, "rr")
+OP(0x56, sstorei, "rf")
+OP(0x57, sstorer, "rr")
 OP_NONE(0x58)
 OP_NONE(0x59)
 OP_NONE(0x5A)
@@ -101,27 +101,27 @@ OP_NONE(0x5C)
 OP_NONE(0x5D)
 OP_NONE(0x5E)
 OP_NONE(0x5F)
-OP_NONE(0x60)
-OP_NONE(0x61)
-OP_NONE(0x62)
-OP_NONE(0x63)
-OP_NONE(0x64)
-OP_NONE(0x65)
+OP(0x60, noise1r, "rr")
+OP(0x61, noise2r, "rrr")
+OP(0x62, noise3r, "rrrr")
+OP(0x63, fbm1i, "rrf")
+OP(0x64, fbm2i, "rrrf")
+OP(0x65, fbm3i, "rrrrf")
 OP_NONE(0x66)
 OP_NONE(0x67)
-OP_NONE(0x68)
-OP_NONE(0x69)
-OP_NONE(0x6A)
+OP(0x68, palloadi, "fff")
+OP(0x69, pali, "rf")
+OP(0x6A, palr, "rr")
 OP_NONE(0x6B)
 OP_NONE(0x6C)
 OP_NONE(0x6D)
 OP_NONE(0x6E)
 OP_NONE(0x6F)
-OP_NONE(0x70)
-OP_NONE(0x71)
-OP_NONE(0x72)
-OP_NONE(0x73)
-OP_NONE(0x74)
+OP(0x70, fsinr, "rr")
+OP(0x71, fcosr, "rr")
+OP(0x72, ftanr, "rr")
+OP(0x73, fatan2r, "rrr")
+OP(0x74, fsqrtr, "rr")
 OP_NONE(0x75)
 OP_NONE(0x76)
 OP_NONE(0x77)
@@ -133,25 +133,25 @@ OP_NONE(0x7C)
 OP_NONE(0x7D)
 OP_NONE(0x7E)
 OP_NONE(0x7F)
-OP(0x80, posi)
-OP(0x81, posr)
-OP(0x82, posendi)
-OP(0x83, posendr)
-OP_NONE(0x84)
-OP_NONE(0x85)
-OP_NONE(0x86)
-OP_NONE(0x87)
-OP_NONE(0x88)
-OP_NONE(0x89)
-OP_NONE(0x8A)
-OP_NONE(0x8B)
-OP_NONE(0x8C)
-OP_NONE(0x8D)
-OP_NONE(0x8E)
+OP(0x80, posi, "f")
+OP(0x81, posr, "r")
+OP(0x82, posendi, "f")
+OP(0x83, posendr, "r")
+OP(0x84, getx, "r")
+OP(0x85, gety, "r")
+OP(0x86, getz, "r")
+OP(0x87, getpolar, "r")
+OP(0x88, fillr, "rrr")
+OP(0x89, copyr, "rrr")
+OP(0x8A, blitr, "rrr")
+OP(0x8B, gradr, "rrrr")
+OP(0x8C, prevwr, "rr")
+OP(0x8D, prevcr, "rr")
+OP(0x8E, prevcopyr, "rrr")
 OP_NONE(0x8F)
-OP_NONE(0x90)
-OP_NONE(0x91)
-OP_NONE(0x92)
+OP(0x90, interpi, "f")
+OP(0x91, subsamplei, "ff")
+OP(0x92, periodici, "f")
 OP_NONE(0x93)
 OP_NONE(0x94)
 OP_NONE(0x95)
@@ -197,52 +197,52 @@ OP_NONE(0xBC)
 OP_NONE(0xBD)
 OP_NONE(0xBE)
 OP_NONE(0xBF)
-OP_NONE(0xC0)
-OP_NONE(0xC1)
-OP_NONE(0xC2)
-OP_NONE(0xC3)
-OP_NONE(0xC4)
-OP_NONE(0xC5)
-OP_NONE(0xC6)
-OP_NONE(0xC7)
-OP_NONE(0xC8)
-OP_NONE(0xC9)
-OP_NONE(0xCA)
-OP_NONE(0xCB)
-OP_NONE(0xCC)
-OP_NONE(0xCD)
-OP_NONE(0xCE)
-OP_NONE(0xCF)
-OP_NONE(0xD0)
-OP_NONE(0xD1)
-OP_NONE(0xD2)
-OP_NONE(0xD3)
-OP_NONE(0xD4)
-OP_NONE(0xD5)
-OP_NONE(0xD6)
-OP_NONE(0xD7)
-OP_NONE(0xD8)
-OP_NONE(0xD9)
-OP_NONE(0xDA)
-OP_NONE(0xDB)
-OP_NONE(0xDC)
-OP_NONE(0xDD)
-OP_NONE(0xDE)
-OP_NONE(0xDF)
-OP_NONE(0xE0)
-OP_NONE(0xE1)
-OP_NONE(0xE2)
-OP_NONE(0xE3)
-OP_NONE(0xE4)
-OP_NONE(0xE5)
-OP_NONE(0xE6)
-OP_NONE(0xE7)
-OP_NONE(0xE8)
-OP_NONE(0xE9)
-OP_NONE(0xEA)
-OP_NONE(0xEB)
-OP_NONE(0xEC)
-OP_NONE(0xED)
+OP_INT(0xC0, imovi, "xd")
+OP_INT(0xC1, imovr, "xx")
+OP_INT(0xC2, iaddi, "xxd")
+OP_INT(0xC3, iaddr, "xxx")
+OP_INT(0xC4, isubr, "xxx")
+OP_INT(0xC5, imuli, "xxd")
+OP_INT(0xC6, imulr, "xxx")
+OP_INT(0xC7, idivi, "xxd")
+OP_INT(0xC8, idivr, "xxx")
+OP_INT(0xC9, imodi, "xxd")
+OP_INT(0xCA, imodr, "xxx")
+OP_INT(0xCB, iremi, "xxd")
+OP_INT(0xCC, iremr, "xxx")
+OP_INT(0xCD, iandi, "xxd")
+OP_INT(0xCE, iandr, "xxx")
+OP_INT(0xCF, iori, "xxd")
+OP_INT(0xD0, iorr, "xxx")
+OP_INT(0xD1, ixori, "xxd")
+OP_INT(0xD2, ixorr, "xxx")
+OP_INT(0xD3, inotr, "xx")
+OP_INT(0xD4, ishli, "xxd")
+OP_INT(0xD5, ishri, "xxd")
+OP_INT(0xD6, isari, "xxd")
+OP_INT(0xD7, iceqi, "xd")
+OP_INT(0xD8, iceqr, "xx")
+OP_INT(0xD9, iclti, "xd")
+OP_INT(0xDA, icltr, "xx")
+OP_INT(0xDB, iclei, "xd")
+OP_INT(0xDC, icler, "xx")
+OP_INT(0xDD, icgti, "xd")
+OP_INT(0xDE, icgtr, "xx")
+OP_INT(0xDF, icgei, "xd")
+OP_INT(0xE0, icger, "xx")
+OP_INT(0xE1, itof, "rx")
+OP_INT(0xE2, ftoi, "xr")
+OP_INT(0xE3, igetticks, "x")
+OP_INT(0xE4, igetpos, "x")
+OP_INT(0xE5, iposr, "x")
+OP_INT(0xE6, iredr, "x")
+OP_INT(0xE7, igreenr, "x")
+OP_INT(0xE8, ibluer, "x")
+OP_INT(0xE9, iloadr, "rx")
+OP_INT(0xEA, istorer, "rx")
+OP_INT(0xEB, igetx, "x")
+OP_INT(0xEC, igety, "x")
+OP_INT(0xED, igetz, "x")
 OP_NONE(0xEE)
 OP_NONE(0xEF)
 OP_NONE(0xF0)
@@ -260,4 +260,4 @@ OP_NONE(0xFB)
 OP_NONE(0xFC)
 OP_NONE(0xFD)
 OP_NONE(0xFE)
-OP(0xFF, halt)
+OP(0xFF, halt, "")
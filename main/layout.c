@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "strip.h"
+#include "layout.h"
+
+struct LayoutPoint *gLayout;
+
+// Layouts, one active and one being loaded
+static struct LayoutPoint sLayouts[2][STRIP_LED_COUNT];
+static size_t sActiveLayout;
+static bool sPending;
+static SemaphoreHandle_t sLayoutLock;
+
+// Fills in the normalized and polar forms of each point from its integer
+// position. Each axis is scaled to [0, 1] over its own extent, and polar
+// coordinates are taken around the centre of the x/y bounding box, with the
+// angle in turns and the radius scaled to [0, 1].
+static void layout_prepare(struct LayoutPoint *layout) {
+	int16_t min[3];
+	int16_t max[3];
+
+	for (size_t a = 0; a < 3; a++) {
+		min[a] = layout[0].pos[a];
+		max[a] = layout[0].pos[a];
+
+		for (size_t i = 1; i < STRIP_LED_COUNT; i++) {
+			if (layout[i].pos[a] < min[a]) {
+				min[a] = layout[i].pos[a];
+			}
+			if (layout[i].pos[a] > max[a]) {
+				max[a] = layout[i].pos[a];
+			}
+		}
+	}
+
+	float maxRadius = 0.0f;
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		for (size_t a = 0; a < 3; a++) {
+			int32_t extent = max[a] - min[a];
+			layout[i].norm[a] = extent == 0 ? 0.0f : (float) (layout[i].pos[a] - min[a]) / extent;
+		}
+
+		float x = layout[i].norm[0] - 0.5f;
+		float y = layout[i].norm[1] - 0.5f;
+		float angle = atan2f(y, x) / (2.0f * (float) M_PI);
+
+		layout[i].angle = angle < 0.0f ? angle + 1.0f : angle;
+		layout[i].radius = sqrtf(x * x + y * y);
+
+		if (layout[i].radius > maxRadius) {
+			maxRadius = layout[i].radius;
+		}
+	}
+
+	if (maxRadius > 0.0f) {
+		for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+			layout[i].radius /= maxRadius;
+		}
+	}
+}
+
+void layout_init(void) {
+	sLayoutLock = xSemaphoreCreateMutex();
+	gLayout = sLayouts[sActiveLayout];
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		gLayout[i].pos[0] = i;
+		gLayout[i].pos[1] = 0;
+		gLayout[i].pos[2] = 0;
+	}
+
+	layout_prepare(gLayout);
+}
+
+// Takes big-endian int16 x, y, z for every LED in order
+void layout_update(const uint8_t *data) {
+	xSemaphoreTake(sLayoutLock, portMAX_DELAY);
+
+	struct LayoutPoint *layout = sLayouts[sActiveLayout ^ 1];
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		for (size_t a = 0; a < 3; a++) {
+			layout[i].pos[a] = (int16_t) (data[0] << 8 | data[1]);
+			data += 2;
+		}
+	}
+
+	layout_prepare(layout);
+	sPending = true;
+
+	xSemaphoreGive(sLayoutLock);
+}
+
+// Called by the bytecode task between frames, so a frame never sees two
+// different layouts. Returns whether the layout changed.
+bool layout_activate(void) {
+	xSemaphoreTake(sLayoutLock, portMAX_DELAY);
+
+	bool changed = sPending;
+	if (sPending) {
+		sActiveLayout ^= 1;
+		gLayout = sLayouts[sActiveLayout];
+		sPending = false;
+	}
+
+	xSemaphoreGive(sLayoutLock);
+
+	return changed;
+}
+
+void layout_serialize(uint8_t *data) {
+	struct LayoutPoint *layout = gLayout;
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		for (size_t a = 0; a < 3; a++) {
+			*data++ = (uint16_t) layout[i].pos[a] >> 8;
+			*data++ = (uint16_t) layout[i].pos[a] & 0xFF;
+		}
+	}
+}
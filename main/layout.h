@@ -0,0 +1,17 @@
+#pragma once
+
+#define LAYOUT_DATA_LEN (STRIP_LED_COUNT * 3 * 2)
+
+struct LayoutPoint {
+	int16_t pos[3];
+	float norm[3];
+	float angle;
+	float radius;
+};
+
+extern struct LayoutPoint *gLayout;
+
+extern void layout_init(void);
+extern void layout_update(const uint8_t *data);
+extern bool layout_activate(void);
+extern void layout_serialize(uint8_t *data);
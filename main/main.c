@@ -1,23 +1,64 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
+
 #include "bytecode.h"
 #include "server.h"
 #include "strip.h"
+#include "layout.h"
+#include "storage.h"
+#include "main.h"
+
+struct BootStats gBootStats;
+
+// Brings back the layout and program that were active before the last reset
+static bool main_restore(void) {
+	uint8_t *buf = heap_caps_malloc(BC_MAX_LEN, MALLOC_CAP_8BIT);
+	if (buf == NULL) {
+		return false;
+	}
+
+	if (storage_load(STORAGE_KEY_LAYOUT, buf, LAYOUT_DATA_LEN) == LAYOUT_DATA_LEN) {
+		layout_update(buf);
+	}
+
+	memset(buf, 0xFF, BC_MAX_LEN);
+	bool restored = storage_load(STORAGE_KEY_BYTECODE, buf, BC_MAX_LEN) > 0 && bc_update(buf, true, 0);
+
+	heap_caps_free(buf);
+	return restored;
+}
 
+// The strip and the program come up first, so the installation lights up
+// right away. Wi-Fi and the server follow in the background.
 void app_main(void) {
 	strip_init();
 	strip_start();
+	gBootStats.stripUs = esp_timer_get_time();
+
+	storage_init();
+	gBootStats.storageUs = esp_timer_get_time();
 
+	layout_init();
 	bc_init();
+	gBootStats.restored = main_restore();
 	bc_start();
+	gBootStats.vmUs = esp_timer_get_time();
 
-	server_init();
 	server_start();
 
+#ifdef CONFIG_BENCH_AT_BOOT
+	bc_bench();
+#endif
+
 /*
 	uint32_t time = 0;
 
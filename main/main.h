@@ -0,0 +1,13 @@
+#pragma once
+
+// When each boot phase finished, in microseconds since boot
+struct BootStats {
+	uint32_t stripUs;
+	uint32_t storageUs;
+	uint32_t vmUs;
+	uint32_t wifiUs;
+	uint32_t serverUs;
+	bool restored;
+};
+
+extern struct BootStats gBootStats;
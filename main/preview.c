@@ -0,0 +1,307 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_http_server.h"
+#include "esp_timer.h"
+
+#include "strip.h"
+#include "preview.h"
+
+struct PreviewClient {
+	int fd;
+	bool busy;
+	bool fresh;
+	uint32_t intervalUs;
+	int64_t nextUs;
+
+	// What the client has been sent so far, and the WebSocket frame being
+	// sent, from start to len. The message follows the frame header.
+	uint8_t last[STRIP_LED_COUNT][3];
+	uint8_t frame[PREVIEW_HEADER_LEN + PREVIEW_MESSAGE_LEN];
+	size_t start;
+	size_t len;
+};
+
+_Static_assert(PREVIEW_MESSAGE_LEN <= UINT16_MAX, "preview messages need a 16-bit WebSocket length");
+
+static struct PreviewClient sClients[PREVIEW_MAX_CLIENTS];
+static portMUX_TYPE sClientLock = portMUX_INITIALIZER_UNLOCKED;
+
+static httpd_handle_t sServer;
+
+static TaskHandle_t sPreviewTask;
+
+static inline bool preview_led_changed(const struct PreviewClient *client, size_t i) {
+	return memcmp(gStripFrontFrame[i], client->last[i], sizeof(client->last[0])) != 0;
+}
+
+// Encodes the LEDs that changed since the client's last frame as runs of
+// [skip:u16][count:u16][count * RGB], reading the front frame in place. A
+// single unchanged LED costs less than a new run header, so it's bridged.
+// Returns false when nothing changed or the frame was replaced mid-read.
+static bool preview_encode(struct PreviewClient *client) {
+	uint32_t seq = gStripFrontSeq;
+	if (seq & 1) {
+		return false;
+	}
+
+	uint8_t *message = &client->frame[PREVIEW_HEADER_LEN];
+	size_t len = 0;
+	size_t prev = 0;
+	size_t i = 0;
+
+	while (i < STRIP_LED_COUNT) {
+		if (!preview_led_changed(client, i)) {
+			i++;
+			continue;
+		}
+
+		size_t end = i + 1;
+		while (end < STRIP_LED_COUNT) {
+			if (preview_led_changed(client, end)) {
+				end++;
+			} else if (end + 1 < STRIP_LED_COUNT && preview_led_changed(client, end + 1)) {
+				end += 2;
+			} else {
+				break;
+			}
+		}
+
+		size_t skip = i - prev;
+		size_t count = end - i;
+
+		message[len++] = skip >> 8;
+		message[len++] = skip;
+		message[len++] = count >> 8;
+		message[len++] = count;
+		memcpy(&message[len], gStripFrontFrame[i], count * sizeof(client->last[0]));
+		len += count * sizeof(client->last[0]);
+
+		prev = end;
+		i = end;
+	}
+
+	if (len == 0 || gStripFrontSeq != seq) {
+		return false;
+	}
+
+	// The front frame may have moved on since, so the message is what counts
+	prev = 0;
+	for (size_t pos = 0; pos < len;) {
+		size_t skip = (size_t) message[pos] << 8 | message[pos + 1];
+		size_t count = (size_t) message[pos + 2] << 8 | message[pos + 3];
+		pos += 4;
+
+		memcpy(client->last[prev + skip], &message[pos], count * sizeof(client->last[0]));
+		pos += count * sizeof(client->last[0]);
+		prev += skip + count;
+	}
+
+	// A final binary frame, unmasked as it comes from the server
+	uint8_t *header = message - (len < 126 ? 2 : 4);
+	header[0] = 0x82;
+	if (len < 126) {
+		header[1] = len;
+	} else {
+		header[1] = 126;
+		header[2] = len >> 8;
+		header[3] = len;
+	}
+
+	client->start = header - client->frame;
+	client->len = PREVIEW_HEADER_LEN + len;
+	return true;
+}
+
+// Runs on the server task, so it never waits on the socket: whatever the
+// client can't take yet is sent on a later pass of the preview task, which
+// holds off on new frames for it until then
+static void preview_send(void *arg) {
+	struct PreviewClient *client = arg;
+
+	bool ok = httpd_ws_get_fd_info(sServer, client->fd) == HTTPD_WS_CLIENT_WEBSOCKET;
+	if (ok) {
+		ssize_t sent = send(client->fd, &client->frame[client->start], client->len - client->start, MSG_DONTWAIT);
+
+		if (sent >= 0) {
+			client->start += sent;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			ok = false;
+		}
+	}
+
+	taskENTER_CRITICAL(&sClientLock);
+	if (!ok) {
+		client->fd = -1;
+	}
+	client->busy = false;
+	taskEXIT_CRITICAL(&sClientLock);
+}
+
+static void preview_task(void *pvParameters) {
+	while (true) {
+		vTaskDelay(pdMS_TO_TICKS(1000 / PREVIEW_MAX_FPS));
+
+		int64_t now = esp_timer_get_time();
+
+		for (size_t i = 0; i < PREVIEW_MAX_CLIENTS; i++) {
+			struct PreviewClient *client = &sClients[i];
+
+			taskENTER_CRITICAL(&sClientLock);
+			bool idle = client->fd >= 0 && !client->busy;
+			bool unsent = idle && !client->fresh && client->start < client->len;
+			bool due = idle && (unsent || now >= client->nextUs);
+			bool fresh = due && client->fresh;
+			if (due) {
+				client->busy = true;
+				client->fresh = false;
+			}
+			taskEXIT_CRITICAL(&sClientLock);
+
+			if (!due) {
+				continue;
+			}
+
+			if (fresh) {
+				memset(client->last, 0, sizeof(client->last));
+				client->start = client->len;
+			}
+
+			bool changed = unsent || preview_encode(client);
+
+			taskENTER_CRITICAL(&sClientLock);
+			if (!changed) {
+				client->busy = false;
+			} else if (!unsent) {
+				client->nextUs = now + client->intervalUs;
+			}
+			taskEXIT_CRITICAL(&sClientLock);
+
+			if (!changed) {
+				continue;
+			}
+
+			if (httpd_queue_work(sServer, preview_send, client) != ESP_OK) {
+				taskENTER_CRITICAL(&sClientLock);
+				client->busy = false;
+				taskEXIT_CRITICAL(&sClientLock);
+			}
+		}
+	}
+}
+
+static struct PreviewClient *preview_find(int fd) {
+	for (size_t i = 0; i < PREVIEW_MAX_CLIENTS; i++) {
+		if (sClients[i].fd == fd) {
+			return &sClients[i];
+		}
+	}
+
+	return NULL;
+}
+
+// A client that goes away is only noticed when a send to it fails, which
+// never happens while its frames don't change. The handshake frees the slots
+// of any such clients first.
+static void preview_reclaim(void) {
+	for (size_t i = 0; i < PREVIEW_MAX_CLIENTS; i++) {
+		struct PreviewClient *client = &sClients[i];
+
+		taskENTER_CRITICAL(&sClientLock);
+		int fd = client->busy ? -1 : client->fd;
+		taskEXIT_CRITICAL(&sClientLock);
+
+		if (fd < 0 || httpd_ws_get_fd_info(sServer, fd) == HTTPD_WS_CLIENT_WEBSOCKET) {
+			continue;
+		}
+
+		taskENTER_CRITICAL(&sClientLock);
+		if (client->fd == fd && !client->busy) {
+			client->fd = -1;
+		}
+		taskEXIT_CRITICAL(&sClientLock);
+	}
+}
+
+// The socket's first request is the WebSocket handshake, which subscribes it
+// at PREVIEW_DEFAULT_FPS. After that, the client can send a frame rate as
+// text. Clients start out from an all-black strip, like a fresh canvas.
+esp_err_t preview_handler(httpd_req_t *req) {
+	int fd = httpd_req_to_sockfd(req);
+
+	if (req->method == HTTP_GET) {
+		preview_reclaim();
+
+		taskENTER_CRITICAL(&sClientLock);
+		struct PreviewClient *client = preview_find(fd);
+		if (client == NULL) {
+			client = preview_find(-1);
+		}
+		if (client != NULL) {
+			client->fd = fd;
+			client->intervalUs = 1000000 / PREVIEW_DEFAULT_FPS;
+			client->nextUs = 0;
+			client->fresh = true;
+		}
+		taskEXIT_CRITICAL(&sClientLock);
+
+		return client != NULL ? ESP_OK : ESP_FAIL;
+	}
+
+	char buf[8];
+	httpd_ws_frame_t frame = {
+		.type = HTTPD_WS_TYPE_TEXT,
+		.payload = (uint8_t *) buf
+	};
+
+	if (httpd_ws_recv_frame(req, &frame, sizeof(buf) - 1) != ESP_OK) {
+		return ESP_FAIL;
+	}
+
+	if (frame.type != HTTPD_WS_TYPE_TEXT) {
+		return ESP_OK;
+	}
+
+	buf[frame.len] = '\0';
+
+	int fps = atoi(buf);
+	if (fps < 1) {
+		fps = 1;
+	} else if (fps > PREVIEW_MAX_FPS) {
+		fps = PREVIEW_MAX_FPS;
+	}
+
+	taskENTER_CRITICAL(&sClientLock);
+	struct PreviewClient *client = preview_find(fd);
+	if (client != NULL) {
+		client->intervalUs = 1000000 / fps;
+		client->nextUs = 0;
+	}
+	taskEXIT_CRITICAL(&sClientLock);
+
+	return ESP_OK;
+}
+
+void preview_start(httpd_handle_t server) {
+	sServer = server;
+
+	for (size_t i = 0; i < PREVIEW_MAX_CLIENTS; i++) {
+		sClients[i].fd = -1;
+	}
+
+	xTaskCreatePinnedToCore(
+		&preview_task,
+		"preview_task",
+		PREVIEW_TASK_STACK_SIZE_BYTES,
+		NULL,
+		PREVIEW_TASK_PRIORITY,
+		&sPreviewTask,
+		PREVIEW_TASK_CORE);
+}
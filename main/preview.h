@@ -0,0 +1,14 @@
+#pragma once
+
+#define PREVIEW_MAX_CLIENTS 2
+#define PREVIEW_DEFAULT_FPS 10
+#define PREVIEW_MAX_FPS 30
+#define PREVIEW_MESSAGE_LEN (STRIP_LED_COUNT * 3 + (STRIP_LED_COUNT / 3 + 1) * 4)
+#define PREVIEW_HEADER_LEN 4
+
+#define PREVIEW_TASK_STACK_SIZE_BYTES 0x1000
+#define PREVIEW_TASK_PRIORITY 1
+#define PREVIEW_TASK_CORE 1
+
+extern void preview_start(httpd_handle_t server);
+extern esp_err_t preview_handler(httpd_req_t *req);
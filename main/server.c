@@ -1,23 +1,83 @@
+#include <ctype.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "freertos/FreeRTOS.h"
+
+#include "esp_app_desc.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
 
 #include "bytecode.h"
+#include "strip.h"
+#include "layout.h"
+#include "preview.h"
+#include "storage.h"
+#include "sync.h"
 #include "wifi.h"
 #include "server.h"
+#include "main.h"
 
 #define SEND_FILE(filename) \
-	extern const uint8_t filename ## _start[] asm("_binary_" #filename "_start"); \
-	extern const uint8_t filename ## _end[] asm("_binary_" #filename "_end"); \
-	httpd_resp_send(req, (const char *) filename ## _start, (size_t) (filename ## _end - filename ## _start));
+	extern const uint8_t filename ## _gz_start[] asm("_binary_" #filename "_gz_start"); \
+	extern const uint8_t filename ## _gz_end[] asm("_binary_" #filename "_gz_end"); \
+	server_send_file(req, filename ## _gz_start, filename ## _gz_end);
+
+// Strong validator for the static files, which only change with the firmware
+static char sETag[SERVER_ETAG_LEN + 3];
+
+static uint8_t sLayoutData[LAYOUT_DATA_LEN];
+static struct BytecodeAnalysis sAnalysis;
+static char sAnalysisJson[1024];
+static char sAnalysisError[sizeof(sAnalysis.error) * 2];
+
+static const char *sFeatureNames[BC_FEATURE_COUNT] = {
+	"random",
+	"trig",
+	"memory",
+	"ledState",
+	"noise",
+	"palette",
+	"fastMath",
+	"layout",
+	"framebuffer",
+	"prevFrame",
+	"renderConfig",
+	"integer"
+};
+
+static const char *sBlendNames[BC_BLEND_COUNT] = {
+	[BC_BLEND_REPLACE] = "replace",
+	[BC_BLEND_ADD] = "add",
+	[BC_BLEND_ALPHA] = "alpha",
+	[BC_BLEND_MAX] = "max"
+};
 
-static uint8_t sNewBytecode[BC_MAX_LEN];
+// Files are stored gzipped. Browsers revalidate on every load, and one that
+// already has this build's copy gets an empty 304.
+static void server_send_file(httpd_req_t *req, const uint8_t *start, const uint8_t *end) {
+	httpd_resp_set_hdr(req, "ETag", sETag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+	char match[64];
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && strstr(match, sETag) != NULL) {
+		httpd_resp_set_status(req, "304 Not Modified");
+		httpd_resp_send(req, NULL, 0);
+		return;
+	}
+
+	httpd_resp_set_status(req, "200 OK");
+	httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+	httpd_resp_send(req, (const char *) start, (size_t) (end - start));
+}
 
 static esp_err_t server_favicon_handler(httpd_req_t *req) {
 	httpd_resp_set_type(req, "image/x-icon");
-	httpd_resp_set_status(req, "200 OK");
 
 	SEND_FILE(favicon_ico);
 	return ESP_OK;
@@ -25,7 +85,6 @@ static esp_err_t server_favicon_handler(httpd_req_t *req) {
 
 static esp_err_t server_index_handler(httpd_req_t *req) {
 	httpd_resp_set_type(req, "text/html");
-	httpd_resp_set_status(req, "200 OK");
 
 	SEND_FILE(index_html);
 	return ESP_OK;
@@ -33,7 +92,6 @@ static esp_err_t server_index_handler(httpd_req_t *req) {
 
 static esp_err_t server_ops_handler(httpd_req_t *req) {
 	httpd_resp_set_type(req, "text/plain");
-	httpd_resp_set_status(req, "200 OK");
 
 	SEND_FILE(ops_h);
 	return ESP_OK;
@@ -47,43 +105,670 @@ static esp_err_t server_bytecode_get_handler(httpd_req_t *req) {
 	return ESP_OK;
 }
 
+// The update has taken effect either way, a failed save only means it won't
+// survive a restart
+static esp_err_t server_send_saved(httpd_req_t *req, const char *what, esp_err_t err) {
+	char buf[128];
+
+	if (err != ESP_OK) {
+		snprintf(buf, sizeof(buf), "Updated %s, but couldn't save it (%s)", what, esp_err_to_name(err));
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, buf);
+		return ESP_FAIL;
+	}
+
+	snprintf(buf, sizeof(buf), "Updated %s successfully", what);
+	httpd_resp_sendstr(req, buf);
+	return ESP_OK;
+}
+
+static esp_err_t server_stats_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_status(req, "200 OK");
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf),
+		"{"
+			"\"vm\":{"
+				"\"frames\":%" PRIu32 ","
+				"\"cancelledFrames\":%" PRIu32 ","
+				"\"errors\":%" PRIu32 ","
+				"\"ledEvals\":%" PRIu32 ","
+				"\"ledEvalsSkipped\":%" PRIu32 ","
+				"\"cachedFrames\":%" PRIu32 ","
+				"\"cacheFailures\":%" PRIu32
+			"},"
+			"\"strip\":{"
+				"\"framesChanged\":%" PRIu32 ","
+				"\"framesUnchanged\":%" PRIu32 ","
+				"\"ledsChanged\":%" PRIu32 ","
+				"\"refreshes\":%" PRIu32 ","
+				"\"interpolatedRefreshes\":%" PRIu32 ","
+				"\"streamedRefreshes\":%" PRIu32 ","
+				"\"streamsDropped\":%" PRIu32 ","
+				"\"sendErrors\":%" PRIu32 ","
+				"\"refreshUs\":%" PRIu64
+			"},"
+			"\"boot\":{"
+				"\"stripUs\":%" PRIu32 ","
+				"\"storageUs\":%" PRIu32 ","
+				"\"vmUs\":%" PRIu32 ","
+				"\"firstRefreshUs\":%" PRIu64 ","
+				"\"wifiUs\":%" PRIu32 ","
+				"\"serverUs\":%" PRIu32 ","
+				"\"restored\":%s"
+			"},"
+			"\"storage\":{"
+				"\"saves\":%" PRIu32 ","
+				"\"saveErrors\":%" PRIu32 ","
+				"\"lastError\":\"%s\""
+			"}"
+		"}",
+		gBytecodeStats.frames,
+		gBytecodeStats.cancelledFrames,
+		gBytecodeStats.errors,
+		gBytecodeStats.ledEvals,
+		gBytecodeStats.ledEvalsSkipped,
+		gBytecodeStats.cachedFrames,
+		gBytecodeStats.cacheFailures,
+		gStripStats.framesChanged,
+		gStripStats.framesUnchanged,
+		gStripStats.ledsChanged,
+		gStripStats.refreshes,
+		gStripStats.interpolatedRefreshes,
+		gStripStats.streamedRefreshes,
+		gStripStats.streamsDropped,
+		gStripStats.sendErrors,
+		gStripStats.refreshUs,
+		gBootStats.stripUs,
+		gBootStats.storageUs,
+		gBootStats.vmUs,
+		gStripStats.firstRefreshUs,
+		gBootStats.wifiUs,
+		gBootStats.serverUs,
+		gBootStats.restored ? "true" : "false",
+		gStorageStats.saves,
+		gStorageStats.saveErrors,
+		esp_err_to_name(gStorageStats.lastError));
+
+	httpd_resp_sendstr(req, buf);
+	return ESP_OK;
+}
+
+static esp_err_t server_sync_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_status(req, "200 OK");
+
+	static const char *roles[] = {
+		[SYNC_ROLE_NONE] = "none",
+		[SYNC_ROLE_LEADER] = "leader",
+		[SYNC_ROLE_FOLLOWER] = "follower"
+	};
+
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"{"
+			"\"role\":\"%s\","
+			"\"locked\":%s,"
+			"\"nowUs\":%" PRId64 ","
+			"\"offsetUs\":%" PRId64 ","
+			"\"beaconsSent\":%" PRIu32 ","
+			"\"beaconsReceived\":%" PRIu32 ","
+			"\"beaconsRejected\":%" PRIu32 ","
+			"\"resets\":%" PRIu32
+		"}",
+		roles[gSyncRole],
+		sync_locked() ? "true" : "false",
+		sync_now(),
+		gSyncStats.offsetUs,
+		gSyncStats.beaconsSent,
+		gSyncStats.beaconsReceived,
+		gSyncStats.beaconsRejected,
+		gSyncStats.resets);
+
+	httpd_resp_sendstr(req, buf);
+	return ESP_OK;
+}
+
+// Streams the request body through bc_stream, which checks it as it arrives.
+// Returns ESP_ERR_INVALID_ARG when it doesn't check out, with sAnalysis
+// saying why, and ESP_FAIL when the client went away or timed out, which has
+// been answered already. On success `bytecode` is the upload, held until the
+// stream is staged or closed.
+static esp_err_t server_recv_bytecode(httpd_req_t *req, uint8_t **bytecode) {
+	size_t len = req->content_len;
+	size_t cur = 0;
+
+	uint8_t chunk[SERVER_UPLOAD_CHUNK_LEN];
+	if (!bc_stream_begin(&sAnalysis, len)) {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, sAnalysis.error);
+		return ESP_FAIL;
+	}
+
+	while (cur < len) {
+		size_t want = len - cur < sizeof(chunk) ? len - cur : sizeof(chunk);
+		int ret = httpd_req_recv(req, (char *) chunk, want);
+
+		if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+			bc_stream_close();
+			httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timed out receiving bytecode");
+			return ESP_FAIL;
+		}
+
+		if (ret <= 0) {
+			bc_stream_close();
+			return ESP_FAIL;
+		}
+
+		cur += ret;
+
+		if (!bc_stream_write(chunk, ret)) {
+			bc_stream_close();
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+
+	if (!bc_stream_end(bytecode)) {
+		bc_stream_close();
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	return ESP_OK;
+}
+
+// An `at` query parameter holds the program back until that time, in the
+// shared time reported by /sync. Giving every controller the same time
+// switches them over on the same frame.
+// The program is checked and stored as it arrives, so a bad one fails as
+// soon as it goes wrong and a good one is ready to run when the last byte is
+// in. A client that stalls for SERVER_RECV_TIMEOUT_S is dropped.
 static esp_err_t server_bytecode_put_handler(httpd_req_t *req) {
 	httpd_resp_set_type(req, "text/plain");
 
 	size_t len = req->content_len;
-	size_t cur = 0;
 
 	if (len > BC_MAX_LEN) {
 		httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Exceeded max bytecode length");
 		return ESP_FAIL;
 	}
 
-	memset(sNewBytecode, 0xFF, sizeof(sNewBytecode));
+	int64_t at = 0;
+	char query[64];
+	char value[24];
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+		httpd_query_key_value(query, "at", value, sizeof(value)) == ESP_OK) {
+		at = strtoll(value, NULL, 10);
+	}
 
-	while (cur < len) {
-		cur += httpd_req_recv(req, (char *) &sNewBytecode[cur], len - cur);
+	uint8_t *upload;
+	esp_err_t err = server_recv_bytecode(req, &upload);
+
+	if (err == ESP_ERR_INVALID_ARG) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, sAnalysis.error);
+		return ESP_FAIL;
 	}
 
-	if (!bc_update(sNewBytecode, true)) {
-		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bytecode checksum verification fail");
+	if (err != ESP_OK) {
 		return ESP_FAIL;
 	}
 
+	const uint8_t *bytecode;
+	if (!bc_stream_stage(at, &bytecode)) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, sAnalysis.error);
+		return ESP_FAIL;
+	}
+
+	// Only uploads write the program areas, so the staged program stays put
 	bc_interrupt();
+	return server_send_saved(req, "bytecode", storage_save(STORAGE_KEY_BYTECODE, bytecode, sAnalysis.len));
+}
+
+static esp_err_t server_effects_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_status(req, "200 OK");
+
+	char buf[96];
+	httpd_resp_sendstr_chunk(req, "[");
+
+	for (size_t i = 0; i < BC_EFFECT_COUNT; i++) {
+		snprintf(buf, sizeof(buf), "%s{\"id\":%u,\"name\":\"%s\",\"len\":%u}",
+			i > 0 ? "," : "",
+			i,
+			gBytecodeEffects[i].name,
+			gBytecodeEffects[i].len);
+		httpd_resp_sendstr_chunk(req, buf);
+	}
 
-	httpd_resp_sendstr(req, "Updated bytecode successfully");
+	httpd_resp_sendstr_chunk(req, "]");
+	httpd_resp_sendstr_chunk(req, NULL);
 	return ESP_OK;
 }
 
-void server_init(void) {
-	wifi_init();
+// Switches to the stock effect given by the id query parameter, which then
+// runs as native code
+static esp_err_t server_effect_put_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "text/plain");
+
+	char query[32];
+	char value[8];
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+		httpd_query_key_value(query, "id", value, sizeof(value)) != ESP_OK) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing effect id");
+		return ESP_FAIL;
+	}
+
+	size_t id = strtoul(value, NULL, 10);
+	if (id >= BC_EFFECT_COUNT) {
+		httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such effect");
+		return ESP_FAIL;
+	}
+
+	const struct BytecodeEffect *effect = &gBytecodeEffects[id];
+	if (!bc_update(effect->bytecode, true, 0)) {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Effect checksum verification fail");
+		return ESP_FAIL;
+	}
+
+	bc_interrupt();
+	return server_send_saved(req, "bytecode", storage_save(STORAGE_KEY_BYTECODE, effect->bytecode, effect->len));
 }
 
-void server_start(void) {
+static esp_err_t server_layers_get_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_status(req, "200 OK");
+
+	char buf[128];
+	httpd_resp_sendstr_chunk(req, "[");
+
+	for (size_t i = 0; i < BC_MAX_LAYERS; i++) {
+		struct BytecodeLayer layer;
+		bc_layer_get(i, &layer);
+
+		snprintf(buf, sizeof(buf), "%s{\"len\":%u,\"start\":%u,\"count\":%u,\"blend\":\"%s\",\"opacity\":%u}",
+			i > 0 ? "," : "",
+			layer.len,
+			layer.start,
+			layer.count,
+			sBlendNames[layer.blend],
+			layer.opacity);
+		httpd_resp_sendstr_chunk(req, buf);
+	}
+
+	httpd_resp_sendstr_chunk(req, "]");
+	httpd_resp_sendstr_chunk(req, NULL);
+	return ESP_OK;
+}
+
+// Reads an optional query parameter, which has to be a plain decimal number
+// no larger than max. Returns false if it isn't, and leaves value as it was
+// if it's missing.
+static bool server_query_number(const char *query, const char *key, uint32_t max, uint32_t *value) {
+	char buf[16];
+	esp_err_t err = httpd_query_key_value(query, key, buf, sizeof(buf));
+
+	if (err == ESP_ERR_NOT_FOUND) {
+		return true;
+	}
+
+	char *end;
+	unsigned long number = strtoul(buf, &end, 10);
+
+	if (err != ESP_OK || !isdigit((unsigned char) buf[0]) || *end != '\0' || number > max) {
+		return false;
+	}
+
+	*value = number;
+	return true;
+}
+
+// The layer to set and how it covers the strip are query parameters:
+// index, start, count, blend (replace, add, alpha or max) and opacity
+// (0-255, ignored by replace). An empty body clears the layer.
+static esp_err_t server_layer_put_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "text/plain");
+
+	size_t len = req->content_len;
+
+	if (len > BC_LAYER_MAX_LEN) {
+		httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Exceeded max layer bytecode length");
+		return ESP_FAIL;
+	}
+
+	char query[128];
+	char value[16];
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+		httpd_query_key_value(query, "index", value, sizeof(value)) != ESP_OK) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing layer index");
+		return ESP_FAIL;
+	}
+
+	// Checked before narrowing into the layer, so out of range values can't
+	// wrap around into valid ones
+	uint32_t index = 0;
+	uint32_t start = 0;
+	uint32_t opacity = 255;
+
+	if (!server_query_number(query, "index", BC_MAX_LAYERS - 1, &index)) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid layer index");
+		return ESP_FAIL;
+	}
+
+	if (!server_query_number(query, "start", STRIP_LED_COUNT - 1, &start)) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid layer start");
+		return ESP_FAIL;
+	}
+
+	uint32_t count = STRIP_LED_COUNT - start;
+
+	if (!server_query_number(query, "count", STRIP_LED_COUNT - start, &count) || count == 0) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid layer count");
+		return ESP_FAIL;
+	}
+
+	if (!server_query_number(query, "opacity", 255, &opacity)) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid layer opacity");
+		return ESP_FAIL;
+	}
+
+	struct BytecodeLayer layer = {
+		.start = start,
+		.count = count,
+		.blend = BC_BLEND_REPLACE,
+		.opacity = opacity
+	};
+
+	if (httpd_query_key_value(query, "blend", value, sizeof(value)) == ESP_OK) {
+		layer.blend = BC_BLEND_COUNT;
+
+		for (size_t i = 0; i < BC_BLEND_COUNT; i++) {
+			if (strcmp(value, sBlendNames[i]) == 0) {
+				layer.blend = i;
+			}
+		}
+	}
+
+	uint8_t *bytecode = NULL;
+
+	if (len > 0) {
+		esp_err_t err = server_recv_bytecode(req, &bytecode);
+
+		if (err == ESP_ERR_INVALID_ARG) {
+			httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, sAnalysis.error);
+			return ESP_FAIL;
+		}
+
+		if (err != ESP_OK) {
+			return ESP_FAIL;
+		}
+	}
+
+	bool ok = bc_layer_update(index, bytecode, &layer, &sAnalysis);
+
+	if (bytecode != NULL) {
+		bc_stream_close();
+	}
+
+	if (!ok) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, sAnalysis.error);
+		return ESP_FAIL;
+	}
+
+	httpd_resp_sendstr(req, len > 0 ? "Updated layer successfully" : "Cleared layer successfully");
+	return ESP_OK;
+}
+
+// Copies src into a JSON string body, escaping quotes, backslashes and
+// control characters. What doesn't fit is cut off between characters.
+static void server_json_escape(char *dest, size_t size, const char *src) {
+	size_t pos = 0;
+
+	for (; *src != '\0'; src++) {
+		unsigned char c = *src;
+		char escaped[7];
+
+		if (c == '"' || c == '\\') {
+			snprintf(escaped, sizeof(escaped), "\\%c", c);
+		} else if (c < 0x20) {
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+		} else {
+			snprintf(escaped, sizeof(escaped), "%c", c);
+		}
+
+		size_t len = strlen(escaped);
+		if (pos + len >= size) {
+			break;
+		}
+
+		memcpy(&dest[pos], escaped, len);
+		pos += len;
+	}
+
+	dest[pos] = '\0';
+}
+
+static esp_err_t server_analyze_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+
+	size_t len = req->content_len;
+
+	if (len > BC_MAX_LEN) {
+		httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Exceeded max bytecode length");
+		return ESP_FAIL;
+	}
+
+	// A program that fails as it arrives is reported like any other
+	uint8_t *bytecode;
+	esp_err_t err = server_recv_bytecode(req, &bytecode);
+
+	if (err != ESP_OK && err != ESP_ERR_INVALID_ARG) {
+		return ESP_FAIL;
+	}
+
+	bool valid = false;
+
+	if (err == ESP_OK) {
+		valid = bc_analyze(bytecode, &sAnalysis);
+		bc_stream_close();
+	}
+
+	server_json_escape(sAnalysisError, sizeof(sAnalysisError), sAnalysis.error);
+
+	char *buf = sAnalysisJson;
+	size_t size = sizeof(sAnalysisJson);
+	size_t pos = 0;
+
+	pos += snprintf(&buf[pos], size - pos,
+		"{"
+			"\"valid\":%s,"
+			"\"error\":\"%s\","
+			"\"len\":%u,"
+			"\"mode\":%u,"
+			"\"instrs\":%" PRIu32 ","
+			"\"regs\":%" PRIu32 ","
+			"\"intRegs\":%" PRIu32 ","
+			"\"memMin\":%" PRId32 ","
+			"\"memMax\":%" PRId32 ","
+			"\"memDynamic\":%s,"
+			"\"loops\":%s,"
+			"\"cost\":%" PRIu32 ","
+			"\"features\":[",
+		valid ? "true" : "false",
+		sAnalysisError,
+		sAnalysis.len,
+		sAnalysis.mode,
+		sAnalysis.instrs,
+		sAnalysis.regs,
+		sAnalysis.intRegs,
+		sAnalysis.memMin,
+		sAnalysis.memMax,
+		sAnalysis.memDynamic ? "true" : "false",
+		sAnalysis.loops ? "true" : "false",
+		sAnalysis.cost);
+
+	bool first = true;
+	for (size_t i = 0; i < BC_FEATURE_COUNT && pos < size; i++) {
+		if (sAnalysis.features & (1U << i)) {
+			pos += snprintf(&buf[pos], size - pos, first ? "\"%s\"" : ",\"%s\"", sFeatureNames[i]);
+			first = false;
+		}
+	}
+
+	if (pos < size) {
+		snprintf(&buf[pos], size - pos,
+			"],"
+			"\"trial\":{"
+				"\"frames\":%" PRIu32 ","
+				"\"timedOut\":%s,"
+				"\"renderUs\":%" PRIu32 ","
+				"\"maxRenderUs\":%" PRIu32 ","
+				"\"instrsPerFrame\":%" PRIu32 ","
+				"\"periodMs\":%" PRIu32 ","
+				"\"tickPeriod\":%" PRIu32 ","
+				"\"cacheFits\":%s,"
+				"\"fps\":%.1f"
+			"}"
+		"}",
+			sAnalysis.frames,
+			sAnalysis.timedOut ? "true" : "false",
+			sAnalysis.renderUs,
+			sAnalysis.maxRenderUs,
+			sAnalysis.instrsPerFrame,
+			sAnalysis.periodMs,
+			sAnalysis.tickPeriod,
+			sAnalysis.cacheFits ? "true" : "false",
+			(double) sAnalysis.fps);
+	}
+
+	httpd_resp_set_status(req, "200 OK");
+	httpd_resp_sendstr(req, buf);
+	return ESP_OK;
+}
+
+static esp_err_t server_bench_send(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_status(req, "200 OK");
+
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"{"
+			"\"cpuMhz\":%" PRIu32 ","
+			"\"dispatch\":%.1f,"
+			"\"decodeU8\":%.1f,"
+			"\"decodeU32\":%.1f,"
+			"\"pipeline\":{"
+				"\"leds\":%d,"
+				"\"renderCycles\":%" PRIu32 ","
+				"\"packCycles\":%" PRIu32 ","
+				"\"refreshUs\":%" PRIu32
+			"},"
+			"\"ops\":{",
+		gBytecodeBench.cpuMhz,
+		(double) gBytecodeBench.dispatch,
+		(double) gBytecodeBench.decodeU8,
+		(double) gBytecodeBench.decodeU32,
+		STRIP_LED_COUNT,
+		gBytecodeBench.renderCycles,
+		gBytecodeBench.packCycles,
+		gBytecodeBench.refreshUs);
+	httpd_resp_sendstr_chunk(req, buf);
+
+	bool first = true;
+	for (size_t i = 0; i < 256; i++) {
+		const struct BytecodeBenchOp *op = &gBytecodeBench.ops[i];
+		if (!op->measured) {
+			continue;
+		}
+
+		snprintf(buf, sizeof(buf), "%s\"%s\":{\"total\":%.1f,\"decode\":%.1f,\"body\":%.1f}",
+			first ? "" : ",",
+			gBytecodeOpNames[i],
+			(double) op->total,
+			(double) op->decode,
+			(double) op->body);
+		httpd_resp_sendstr_chunk(req, buf);
+		first = false;
+	}
+
+	httpd_resp_sendstr_chunk(req, "},\"effects\":{");
+
+	for (size_t i = 0; i < BC_EFFECT_COUNT; i++) {
+		const struct BytecodeBenchEffect *effect = &gBytecodeBench.effects[i];
+
+		snprintf(buf, sizeof(buf), "%s\"%s\":{\"interpretedCycles\":%" PRIu32 ",\"nativeCycles\":%" PRIu32 "}",
+			i > 0 ? "," : "",
+			gBytecodeEffects[i].name,
+			effect->interpretedCycles,
+			effect->nativeCycles);
+		httpd_resp_sendstr_chunk(req, buf);
+	}
+
+	httpd_resp_sendstr_chunk(req, "}}");
+	httpd_resp_sendstr_chunk(req, NULL);
+	return ESP_OK;
+}
+
+static esp_err_t server_bench_get_handler(httpd_req_t *req) {
+	if (!gBytecodeBench.done) {
+		httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No benchmark results yet");
+		return ESP_FAIL;
+	}
+
+	return server_bench_send(req);
+}
+
+static esp_err_t server_bench_post_handler(httpd_req_t *req) {
+	if (!bc_bench()) {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not enough memory for the benchmark");
+		return ESP_FAIL;
+	}
+
+	return server_bench_send(req);
+}
+
+static esp_err_t server_layout_get_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "application/octet-stream");
+	httpd_resp_set_status(req, "200 OK");
+
+	layout_serialize(sLayoutData);
+
+	httpd_resp_send(req, (char *) sLayoutData, sizeof(sLayoutData));
+	return ESP_OK;
+}
+
+static esp_err_t server_layout_put_handler(httpd_req_t *req) {
+	httpd_resp_set_type(req, "text/plain");
+
+	size_t len = req->content_len;
+	size_t cur = 0;
+
+	if (len != LAYOUT_DATA_LEN) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Layout must have an x, y and z for every LED");
+		return ESP_FAIL;
+	}
+
+	while (cur < len) {
+		int ret = httpd_req_recv(req, (char *) &sLayoutData[cur], len - cur);
+		if (ret <= 0) {
+			return ESP_FAIL;
+		}
+
+		cur += ret;
+	}
+
+	layout_update(sLayoutData);
+	return server_send_saved(req, "layout", storage_save(STORAGE_KEY_LAYOUT, sLayoutData, sizeof(sLayoutData)));
+}
+
+static void server_httpd_start(void) {
+	char hash[SERVER_ETAG_LEN + 1];
+	esp_app_get_elf_sha256(hash, sizeof(hash));
+	snprintf(sETag, sizeof(sETag), "\"%s\"", hash);
+
 	httpd_config_t httpdCfg = HTTPD_DEFAULT_CONFIG();
 	httpdCfg.stack_size = SERVER_TASK_STACK_SIZE_BYTES;
 	httpdCfg.task_priority = SERVER_TASK_PRIORITY;
 	httpdCfg.core_id = SERVER_TASK_CORE;
+	httpdCfg.max_uri_handlers = SERVER_MAX_URI_HANDLERS;
+	httpdCfg.recv_wait_timeout = SERVER_RECV_TIMEOUT_S;
 
 	httpd_handle_t server;
 	httpd_start(&server, &httpdCfg);
@@ -113,10 +798,97 @@ void server_start(void) {
 			.uri = "/bytecode.bin",
 			.method = HTTP_PUT,
 			.handler = server_bytecode_put_handler
+		},
+		{
+			.uri = "/effects",
+			.method = HTTP_GET,
+			.handler = server_effects_handler
+		},
+		{
+			.uri = "/effect",
+			.method = HTTP_PUT,
+			.handler = server_effect_put_handler
+		},
+		{
+			.uri = "/layers",
+			.method = HTTP_GET,
+			.handler = server_layers_get_handler
+		},
+		{
+			.uri = "/layer.bin",
+			.method = HTTP_PUT,
+			.handler = server_layer_put_handler
+		},
+		{
+			.uri = "/bytecode/analyze",
+			.method = HTTP_POST,
+			.handler = server_analyze_handler
+		},
+		{
+			.uri = "/bench",
+			.method = HTTP_GET,
+			.handler = server_bench_get_handler
+		},
+		{
+			.uri = "/bench",
+			.method = HTTP_POST,
+			.handler = server_bench_post_handler
+		},
+		{
+			.uri = "/layout.bin",
+			.method = HTTP_GET,
+			.handler = server_layout_get_handler
+		},
+		{
+			.uri = "/layout.bin",
+			.method = HTTP_PUT,
+			.handler = server_layout_put_handler
+		},
+		{
+			.uri = "/stats",
+			.method = HTTP_GET,
+			.handler = server_stats_handler
+		},
+		{
+			.uri = "/sync",
+			.method = HTTP_GET,
+			.handler = server_sync_handler
+		},
+		{
+			.uri = "/preview",
+			.method = HTTP_GET,
+			.handler = preview_handler,
+			.is_websocket = true
 		}
 	};
 
 	for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
 		httpd_register_uri_handler(server, &uris[i]);
 	}
+
+	preview_start(server);
+}
+
+static void server_task(void *pvParameters) {
+	wifi_init();
+	sync_start();
+	gBootStats.wifiUs = esp_timer_get_time();
+
+	server_httpd_start();
+	gBootStats.serverUs = esp_timer_get_time();
+
+	vTaskDelete(NULL);
+}
+
+// Wi-Fi and httpd bring-up takes a while, so it runs on the server core
+// without holding up the rest of boot
+void server_start(void) {
+	xTaskCreatePinnedToCore(
+		&server_task,
+		"server_task",
+		SERVER_TASK_STACK_SIZE_BYTES,
+		NULL,
+		SERVER_TASK_PRIORITY,
+		NULL,
+		SERVER_TASK_CORE);
 }
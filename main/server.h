@@ -2,7 +2,10 @@
 
 #define SERVER_TASK_STACK_SIZE_BYTES 0x4000
 #define SERVER_TASK_PRIORITY 1
-#define SERVER_TASK_CORE 0
+#define SERVER_TASK_CORE 1
+#define SERVER_MAX_URI_HANDLERS 20
+#define SERVER_ETAG_LEN 16
+#define SERVER_RECV_TIMEOUT_S 5
+#define SERVER_UPLOAD_CHUNK_LEN 0x400
 
-extern void server_init(void);
 extern void server_start(void);
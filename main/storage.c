@@ -0,0 +1,51 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "storage.h"
+
+struct StorageStats gStorageStats;
+
+static nvs_handle_t sStorage;
+static bool sReady;
+
+// Also sets up NVS for the Wi-Fi driver, which keeps its calibration there
+void storage_init(void) {
+	esp_err_t err = nvs_flash_init();
+	if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+		nvs_flash_erase();
+		err = nvs_flash_init();
+	}
+
+	sReady = err == ESP_OK && nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &sStorage) == ESP_OK;
+}
+
+// Returns the length of the stored value, or 0 if there's none that fits
+size_t storage_load(const char *key, void *data, size_t maxLen) {
+	size_t len = maxLen;
+
+	if (!sReady || nvs_get_blob(sStorage, key, data, &len) != ESP_OK) {
+		return 0;
+	}
+
+	return len;
+}
+
+esp_err_t storage_save(const char *key, const void *data, size_t len) {
+	esp_err_t err = sReady ? nvs_set_blob(sStorage, key, data, len) : ESP_ERR_NVS_NOT_INITIALIZED;
+	if (err == ESP_OK) {
+		err = nvs_commit(sStorage);
+	}
+
+	if (err != ESP_OK) {
+		gStorageStats.saveErrors++;
+		gStorageStats.lastError = err;
+		return err;
+	}
+
+	gStorageStats.saves++;
+	return ESP_OK;
+}
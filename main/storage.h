@@ -0,0 +1,17 @@
+#pragma once
+
+#define STORAGE_NAMESPACE "blinky"
+#define STORAGE_KEY_BYTECODE "bytecode"
+#define STORAGE_KEY_LAYOUT "layout"
+
+struct StorageStats {
+	uint32_t saves;
+	uint32_t saveErrors;
+	esp_err_t lastError;
+};
+
+extern struct StorageStats gStorageStats;
+
+extern void storage_init(void);
+extern size_t storage_load(const char *key, void *data, size_t maxLen);
+extern esp_err_t storage_save(const char *key, const void *data, size_t len);
@@ -4,71 +4,568 @@
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
-#include "led_strip.h"
+#include "driver/rmt_tx.h"
+#include "esp_timer.h"
 
 #include "strip.h"
 
 enum StripMode gStripMode = STRIP_MODE_RGB;
+bool gStripInterpolate;
 uint32_t gStripData[STRIP_LED_COUNT][3];
+struct StripStats gStripStats;
 
-static led_strip_handle_t sStrip;
+// Last published frame, packed to 8-bit RGB. Readers outside the lock check
+// that gStripFrontSeq is even and unchanged across their read.
+static uint8_t sFrontFrame[STRIP_LED_COUNT][3];
+const uint8_t (*const gStripFrontFrame)[3] = sFrontFrame;
+volatile uint32_t gStripFrontSeq;
+static size_t sDirtyStart = STRIP_LED_COUNT;
+static size_t sDirtyEnd = 0;
+
+// Previous and current keyframe for interpolated output, in the units of
+// their strip mode
+static uint16_t sKeyframes[2][STRIP_LED_COUNT][3];
+static enum StripMode sKeyframeModes[2];
+static int64_t sKeyframeTime;
+static uint32_t sKeyframeUs;
+static bool sKeyframeNew;
+static bool sInterpolate;
+
+enum StripStream {
+	STRIP_STREAM_IDLE,
+	STRIP_STREAM_RENDERING,
+	STRIP_STREAM_RENDERED,
+	STRIP_STREAM_DROPPED,
+	STRIP_STREAM_STARVED
+};
+
+// A frame the strip task sends out while the render task is still packing
+// it. LEDs before sStreamReady are final. Once sStreamSending is set the
+// strip task sees the frame through, otherwise publishing it takes the usual
+// path. The state only changes under sFrontLock.
+static uint8_t sStreamFrame[STRIP_LED_COUNT][3];
+static enum StripMode sStreamMode;
+static volatile enum StripStream sStreamState;
+static volatile size_t sStreamReady;
+static volatile bool sStreamSending;
+static int64_t sStreamStartUs;
+
+static portMUX_TYPE sFrontLock = portMUX_INITIALIZER_UNLOCKED;
+
+static rmt_channel_handle_t sChannel;
+static rmt_encoder_handle_t sEncoder;
+static bool sReady;
+static esp_timer_handle_t sResetTimer;
+static SemaphoreHandle_t sResetDone;
+
+// What the strip is sent, in wire order. Each chunk is its own transaction,
+// so one chunk can be filled in while the one before is going out.
+static uint8_t sWire[STRIP_LED_COUNT][3];
+static uint32_t sChunksQueued;
+static volatile uint32_t sChunksSent;
+static int64_t sLineIdleUs;
 
 static TaskHandle_t sStripTask;
 
-static void strip_update(void) {
-	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
-		switch (gStripMode) {
+// A refresh timed on request, see strip_time_refresh
+static volatile bool sTimeRequested;
+static SemaphoreHandle_t sTimeDone;
+static uint32_t sTimeUs;
+
+static void strip_hsv_to_rgb(uint32_t hue, uint32_t sat, uint32_t val, uint8_t *rgb) {
+	uint32_t max = val;
+	uint32_t min = max * (255 - sat) / 255;
+	uint32_t adj = (max - min) * (hue % 60) / 60;
+
+	switch (hue / 60) {
+		case 0:
+			rgb[0] = max;
+			rgb[1] = min + adj;
+			rgb[2] = min;
+			break;
+
+		case 1:
+			rgb[0] = max - adj;
+			rgb[1] = max;
+			rgb[2] = min;
+			break;
+
+		case 2:
+			rgb[0] = min;
+			rgb[1] = max;
+			rgb[2] = min + adj;
+			break;
+
+		case 3:
+			rgb[0] = min;
+			rgb[1] = max - adj;
+			rgb[2] = max;
+			break;
+
+		case 4:
+			rgb[0] = min + adj;
+			rgb[1] = min;
+			rgb[2] = max;
+			break;
+
+		default:
+			rgb[0] = max;
+			rgb[1] = min;
+			rgb[2] = max - adj;
+			break;
+	}
+}
+
+static void strip_to_rgb(const uint16_t *src, enum StripMode mode, uint8_t *rgb) {
+	switch (mode) {
+		case STRIP_MODE_RGB:
+			rgb[0] = src[0];
+			rgb[1] = src[1];
+			rgb[2] = src[2];
+			break;
+
+		case STRIP_MODE_HSV:
+			strip_hsv_to_rgb(src[0], src[1], src[2], rgb);
+			break;
+	}
+}
+
+// Blends LED i between the previous and current keyframe, t going from 0 to
+// 256. Two HSV keyframes blend hue along the shorter way around the wheel,
+// anything else blends in RGB.
+static void strip_blend(
+	uint16_t keys[2][STRIP_LED_COUNT][3],
+	const enum StripMode modes[2],
+	size_t i,
+	int32_t t,
+	uint8_t *rgb) {
+	const uint16_t *a = keys[0][i];
+	const uint16_t *b = keys[1][i];
+
+	if (modes[0] == STRIP_MODE_HSV && modes[1] == STRIP_MODE_HSV) {
+		int32_t hue = b[0] - a[0];
+		if (hue > 180) {
+			hue -= 360;
+		} else if (hue < -180) {
+			hue += 360;
+		}
+
+		strip_hsv_to_rgb(
+			(a[0] + ((hue * t) >> 8) + 360) % 360,
+			a[1] + (((b[1] - a[1]) * t) >> 8),
+			a[2] + (((b[2] - a[2]) * t) >> 8),
+			rgb);
+		return;
+	}
+
+	uint8_t from[3];
+	uint8_t to[3];
+	strip_to_rgb(a, modes[0], from);
+	strip_to_rgb(b, modes[1], to);
+
+	for (size_t c = 0; c < 3; c++) {
+		rgb[c] = from[c] + (((to[c] - from[c]) * t) >> 8);
+	}
+}
+
+void strip_pack(uint8_t frame[STRIP_LED_COUNT][3]) {
+	strip_pack_range(frame, 0, STRIP_LED_COUNT);
+}
+
+// Packs just the LEDs from start, leaving the rest of frame as it was
+void strip_pack_range(uint8_t (*frame)[3], size_t start, size_t count) {
+	strip_pack_from(frame, gStripData, gStripMode, start, count);
+}
+
+// Packs LEDs from a strip other than the live one, such as a sandbox's
+void strip_pack_from(uint8_t (*frame)[3], const uint32_t (*data)[3], enum StripMode mode, size_t start, size_t count) {
+	for (size_t i = start; i < start + count; i++) {
+		switch (mode) {
 			case STRIP_MODE_RGB:
-				led_strip_set_pixel(
-					sStrip,
-					i,
-					gStripData[i][0] % 256,
-					gStripData[i][1] % 256,
-					gStripData[i][2] % 256);
+				frame[i][0] = data[i][0] % 256;
+				frame[i][1] = data[i][1] % 256;
+				frame[i][2] = data[i][2] % 256;
 				break;
 
 			case STRIP_MODE_HSV:
-				led_strip_set_pixel_hsv(
-					sStrip,
-					i,
-					gStripData[i][0] % 360,
-					gStripData[i][1] % 256,
-					gStripData[i][2] % 256);
+				strip_hsv_to_rgb(
+					data[i][0] % 360,
+					data[i][1] % 256,
+					data[i][2] % 256,
+					frame[i]);
+				break;
+		}
+	}
+}
+
+static bool strip_sent(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event, void *arg) {
+	sChunksSent++;
+	return false;
+}
+
+static void strip_set_pixel(size_t i, const uint8_t *rgb) {
+	sWire[i][0] = rgb[1];
+	sWire[i][1] = rgb[0];
+	sWire[i][2] = rgb[2];
+}
+
+static void strip_reset_done(void *arg) {
+	xSemaphoreGive(sResetDone);
+}
+
+// The strip latches what it was sent last once the line has been low for
+// STRIP_RESET_US, anything sent before then would run on from there
+static void strip_send_begin(void) {
+	int64_t wait = sLineIdleUs + STRIP_RESET_US - esp_timer_get_time();
+	if (wait > 0 && esp_timer_start_once(sResetTimer, wait) == ESP_OK) {
+		xSemaphoreTake(sResetDone, portMAX_DELAY);
+	}
+
+	sChunksQueued = 0;
+	sChunksSent = 0;
+}
+
+static bool strip_send(size_t start, size_t count) {
+	rmt_transmit_config_t transmitCfg = {
+		.loop_count = 0
+	};
+
+	if (!sReady || rmt_transmit(sChannel, sEncoder, sWire[start], count * sizeof(sWire[0]), &transmitCfg) != ESP_OK) {
+		gStripStats.sendErrors++;
+		return false;
+	}
+
+	sChunksQueued++;
+	return true;
+}
+
+// Whether everything queued has gone out, leaving the line low
+static bool strip_send_idle(void) {
+	return sChunksSent == sChunksQueued;
+}
+
+static void strip_send_end(void) {
+	if (sChunksQueued > 0 && rmt_tx_wait_all_done(sChannel, -1) != ESP_OK) {
+		gStripStats.sendErrors++;
+	}
+
+	sLineIdleUs = esp_timer_get_time();
+}
+
+static bool strip_refresh(void) {
+	strip_send_begin();
+	bool sent = strip_send(0, STRIP_LED_COUNT);
+	strip_send_end();
+
+	return sent;
+}
+
+static void strip_update(void) {
+	static uint8_t frame[STRIP_LED_COUNT][3];
+
+	taskENTER_CRITICAL(&sFrontLock);
+	size_t start = sDirtyStart;
+	size_t end = sDirtyEnd;
+	if (start < end) {
+		memcpy(&frame[start], &sFrontFrame[start], (end - start) * sizeof(frame[0]));
+	}
+	sDirtyStart = STRIP_LED_COUNT;
+	sDirtyEnd = 0;
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	if (start >= end) {
+		return;
+	}
+
+	for (size_t i = start; i < end; i++) {
+		strip_set_pixel(i, frame[i]);
+	}
+
+	int64_t time = esp_timer_get_time();
+	if (!strip_refresh()) {
+		// Tried again with the next frame
+		taskENTER_CRITICAL(&sFrontLock);
+		sDirtyStart = 0;
+		sDirtyEnd = STRIP_LED_COUNT;
+		taskEXIT_CRITICAL(&sFrontLock);
+		return;
+	}
+
+	gStripStats.refreshes++;
+	gStripStats.refreshUs += esp_timer_get_time() - time;
+	if (gStripStats.firstRefreshUs == 0) {
+		gStripStats.firstRefreshUs = esp_timer_get_time();
+	}
+}
+
+// Shows one step of the blend between the last two keyframes, returning
+// whether there are more steps to go
+static bool strip_interpolate(void) {
+	static uint16_t keys[2][STRIP_LED_COUNT][3];
+	static enum StripMode modes[2];
+	static int64_t start;
+	static uint32_t duration;
+
+	taskENTER_CRITICAL(&sFrontLock);
+	if (sKeyframeNew) {
+		memcpy(keys, sKeyframes, sizeof(keys));
+		modes[0] = sKeyframeModes[0];
+		modes[1] = sKeyframeModes[1];
+		start = sKeyframeTime;
+		duration = sKeyframeUs;
+		sKeyframeNew = false;
+	}
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	int64_t elapsed = esp_timer_get_time() - start;
+	int32_t t = elapsed >= duration ? 256 : (int32_t) (elapsed * 256 / duration);
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		uint8_t rgb[3];
+		strip_blend(keys, modes, i, t, rgb);
+		strip_set_pixel(i, rgb);
+	}
+
+	int64_t time = esp_timer_get_time();
+	if (!strip_refresh()) {
+		return t < 256;
+	}
+
+	gStripStats.refreshes++;
+	gStripStats.interpolatedRefreshes++;
+	gStripStats.refreshUs += esp_timer_get_time() - time;
+	if (gStripStats.firstRefreshUs == 0) {
+		gStripStats.firstRefreshUs = esp_timer_get_time();
+	}
+
+	return t < 256;
+}
+
+// Whether the LEDs still to come will be packed before the strip needs them,
+// going by how fast the ready ones were. The next chunk is needed once the
+// ready ones are out and the last one once all but it are.
+static bool strip_stream_due(size_t ready, int64_t startUs) {
+	if (ready == STRIP_LED_COUNT) {
+		return true;
+	}
+
+	if (ready < STRIP_CHUNK_LEDS) {
+		return false;
+	}
+
+	int64_t elapsed = esp_timer_get_time() - startUs;
+	size_t sendable = ready - ready % STRIP_CHUNK_LEDS;
+
+	int64_t nextUs = elapsed * (int64_t) (sendable + STRIP_CHUNK_LEDS - ready) / (int64_t) ready;
+	int64_t lastUs = elapsed * (int64_t) (STRIP_LED_COUNT - ready) / (int64_t) ready;
+
+	return nextUs + STRIP_STREAM_MARGIN_US <= (int64_t) sendable * STRIP_LED_US &&
+		lastUs + STRIP_STREAM_MARGIN_US <= (int64_t) (STRIP_LED_COUNT - STRIP_CHUNK_LEDS) * STRIP_LED_US;
+}
+
+// Sends the streamed frame a chunk at a time as the render task packs it,
+// starting at the first change from what's shown. Should the render fall
+// behind and the line go idle, the strip may have latched part of the frame,
+// so the rest isn't sent. Once the frame is published, only what differs from
+// that part is left to send, unless it turns out not to be what was streamed.
+static void strip_stream(void) {
+	size_t sent = 0;
+	bool started = false;
+	bool starved = false;
+	int64_t time = 0;
+
+	while (true) {
+		taskENTER_CRITICAL(&sFrontLock);
+		enum StripStream state = sStreamState;
+		size_t ready = sStreamReady;
+		int64_t startUs = sStreamStartUs;
+		bool changed = sent > 0 || memcmp(sStreamFrame, sFrontFrame, ready * sizeof(sStreamFrame[0])) != 0;
+		taskEXIT_CRITICAL(&sFrontLock);
+
+		if (state == STRIP_STREAM_DROPPED || (state == STRIP_STREAM_RENDERED && (sent == STRIP_LED_COUNT || !changed))) {
+			break;
+		}
+
+		if (!started) {
+			if (!changed || !strip_stream_due(ready, startUs)) {
+				ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+				continue;
+			}
+
+			// From here on the frame is this task's to deliver, unless it was
+			// published in the meantime
+			taskENTER_CRITICAL(&sFrontLock);
+			started = sStreamState == STRIP_STREAM_RENDERING;
+			sStreamSending = started;
+			taskEXIT_CRITICAL(&sFrontLock);
+
+			if (!started) {
+				continue;
+			}
+
+			strip_send_begin();
+			time = esp_timer_get_time();
+		}
+
+		size_t end = ready == STRIP_LED_COUNT ? ready : ready - ready % STRIP_CHUNK_LEDS;
+
+		while (sent < end) {
+			if (sent > 0 && strip_send_idle()) {
+				starved = true;
+				break;
+			}
+
+			size_t count = end - sent < STRIP_CHUNK_LEDS ? end - sent : STRIP_CHUNK_LEDS;
+			for (size_t i = sent; i < sent + count; i++) {
+				strip_set_pixel(i, sStreamFrame[i]);
+			}
+
+			if (!strip_send(sent, count)) {
+				starved = true;
 				break;
+			}
+			sent += count;
+		}
+
+		if (starved) {
+			break;
 		}
+
+		if (state == STRIP_STREAM_RENDERING) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+	}
+
+	if (started) {
+		strip_send_end();
 	}
 
-	led_strip_refresh(sStrip);
+	taskENTER_CRITICAL(&sFrontLock);
+	bool delivered = sent == STRIP_LED_COUNT && !starved && sStreamState == STRIP_STREAM_RENDERED;
+	if (started && !delivered && sStreamState == STRIP_STREAM_RENDERING) {
+		sStreamState = STRIP_STREAM_STARVED;
+	} else {
+		if (started && !delivered) {
+			sDirtyStart = 0;
+			sDirtyEnd = STRIP_LED_COUNT;
+		}
+		sStreamState = STRIP_STREAM_IDLE;
+	}
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	if (delivered) {
+		gStripStats.refreshes++;
+		gStripStats.streamedRefreshes++;
+		gStripStats.refreshUs += sLineIdleUs - time;
+		if (gStripStats.firstRefreshUs == 0) {
+			gStripStats.firstRefreshUs = sLineIdleUs;
+		}
+	} else if (started) {
+		gStripStats.streamsDropped++;
+	}
+}
+
+// Sends what was sent last once more, which leaves the strip as it is
+static void strip_time(void) {
+	strip_send_begin();
+	int64_t time = esp_timer_get_time();
+	bool sent = strip_send(0, STRIP_LED_COUNT);
+	strip_send_end();
+
+	sTimeUs = sent ? sLineIdleUs - time : 0;
 }
 
 static void strip_task(void *pvParameters) {
+	bool interpolating = false;
+
 	while (true) {
-		strip_update();
+		ulTaskNotifyTake(pdTRUE, interpolating ? 0 : portMAX_DELAY);
+
+		if (sTimeRequested) {
+			strip_time();
+			sTimeRequested = false;
+			xSemaphoreGive(sTimeDone);
+		}
+
+		taskENTER_CRITICAL(&sFrontLock);
+		bool interpolate = sInterpolate;
+		bool streaming = sStreamState != STRIP_STREAM_IDLE && sStreamState != STRIP_STREAM_STARVED;
+		taskEXIT_CRITICAL(&sFrontLock);
+
+		// An older frame still waiting goes out ahead of a streamed one
+		if (streaming) {
+			if (!interpolate) {
+				strip_update();
+			}
+
+			strip_stream();
+		}
+
+		if (interpolate) {
+			interpolating = strip_interpolate();
+		} else {
+			strip_update();
+			interpolating = false;
+		}
 	}
 }
 
 void strip_reset(void) {
 	gStripMode = STRIP_MODE_RGB;
+	gStripInterpolate = false;
 	memset(gStripData, 0, sizeof(gStripData));
 }
 
 void strip_init(void) {
 	strip_reset();
 
-	led_strip_config_t stripCfg = {
-		.strip_gpio_num = STRIP_PIN,
-		.led_model = STRIP_LED_MODEL,
-		.color_component_format = STRIP_LED_COLOR_FORMAT,
-		.max_leds = STRIP_LED_COUNT,
+	sResetDone = xSemaphoreCreateBinary();
+	sTimeDone = xSemaphoreCreateBinary();
+
+	esp_timer_create_args_t resetArgs = {
+		.callback = &strip_reset_done,
+		.name = "strip_reset"
 	};
+	esp_timer_create(&resetArgs, &sResetTimer);
 
-	led_strip_rmt_config_t rmtCfg = {
+	rmt_tx_channel_config_t channelCfg = {
+		.gpio_num = STRIP_PIN,
+		.clk_src = RMT_CLK_SRC_DEFAULT,
+		.resolution_hz = STRIP_RMT_RESOLUTION_HZ,
+		.mem_block_symbols = STRIP_RMT_MEM_BLOCK_SYMBOLS,
+		.trans_queue_depth = STRIP_CHUNK_COUNT,
 		.flags.with_dma = true
 	};
 
-	led_strip_new_rmt_device(&stripCfg, &rmtCfg, &sStrip);
-	led_strip_clear(sStrip);
+	rmt_bytes_encoder_config_t encoderCfg = {
+		.bit0 = {
+			.level0 = 1,
+			.duration0 = STRIP_T0H_TICKS,
+			.level1 = 0,
+			.duration1 = STRIP_T0L_TICKS
+		},
+		.bit1 = {
+			.level0 = 1,
+			.duration0 = STRIP_T1H_TICKS,
+			.level1 = 0,
+			.duration1 = STRIP_T1L_TICKS
+		},
+		.flags.msb_first = true
+	};
+
+	rmt_tx_event_callbacks_t callbacks = {
+		.on_trans_done = &strip_sent
+	};
+
+	// Without a channel nothing is sent, and every refresh counts as an error
+	sReady = rmt_new_tx_channel(&channelCfg, &sChannel) == ESP_OK &&
+		rmt_new_bytes_encoder(&encoderCfg, &sEncoder) == ESP_OK &&
+		rmt_tx_register_event_callbacks(sChannel, &callbacks, NULL) == ESP_OK &&
+		rmt_enable(sChannel) == ESP_OK;
+
+	strip_refresh();
 }
 
 void strip_start(void) {
@@ -82,10 +579,224 @@ void strip_start(void) {
 		STRIP_TASK_CORE);
 }
 
-void strip_suspend(void) {
-	vTaskSuspend(sStripTask);
+// Starts a blend from the current keyframe to key, lasting intervalUs. Coming
+// from direct output, the blend starts from what's shown.
+static void strip_push_keyframe(const uint16_t key[STRIP_LED_COUNT][3], enum StripMode mode, uint32_t intervalUs) {
+	if (!sInterpolate) {
+		for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+			sKeyframes[1][i][0] = sFrontFrame[i][0];
+			sKeyframes[1][i][1] = sFrontFrame[i][1];
+			sKeyframes[1][i][2] = sFrontFrame[i][2];
+		}
+
+		sKeyframeModes[1] = STRIP_MODE_RGB;
+		sInterpolate = true;
+	}
+
+	memcpy(sKeyframes[0], sKeyframes[1], sizeof(sKeyframes[0]));
+	sKeyframeModes[0] = sKeyframeModes[1];
+
+	memcpy(sKeyframes[1], key, sizeof(sKeyframes[1]));
+	sKeyframeModes[1] = mode;
+	sKeyframeTime = esp_timer_get_time();
+	sKeyframeUs = intervalUs;
+	sKeyframeNew = true;
+}
+
+// Opens a stream for the frame about to be rendered, unless output is
+// interpolated or the last stream is still going out
+bool strip_stream_begin(void) {
+	taskENTER_CRITICAL(&sFrontLock);
+	bool open = sReady && !sInterpolate && sStreamState == STRIP_STREAM_IDLE;
+	if (open) {
+		sStreamState = STRIP_STREAM_RENDERING;
+		sStreamReady = 0;
+		sStreamSending = false;
+		sStreamStartUs = esp_timer_get_time();
+	}
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	return open;
 }
 
-void strip_resume(void) {
-	vTaskResume(sStripTask);
+// Settles a starved stream. The strip shows the start of the streamed frame,
+// which is fine if that's the frame published and otherwise needs covering up.
+static bool strip_stream_settle(bool streamed) {
+	bool starved = sStreamState == STRIP_STREAM_STARVED;
+	if (starved) {
+		if (!streamed) {
+			sDirtyStart = 0;
+			sDirtyEnd = STRIP_LED_COUNT;
+		}
+		sStreamState = STRIP_STREAM_IDLE;
+	}
+
+	return starved;
+}
+
+// For a frame that won't be published, or not as it was streamed
+void strip_stream_drop(void) {
+	taskENTER_CRITICAL(&sFrontLock);
+	bool open = sStreamState == STRIP_STREAM_RENDERING;
+	if (open) {
+		sStreamState = STRIP_STREAM_DROPPED;
+	}
+	open |= strip_stream_settle(false);
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	if (open) {
+		xTaskNotifyGive(sStripTask);
+	}
+}
+
+// The LEDs before end are final. They're packed and handed to the strip task
+// a chunk at a time. Packing goes by the strip mode, so a program switching
+// modes partway through drops the stream.
+void strip_stream_advance(size_t end) {
+	size_t ready = sStreamReady;
+
+	if (sStreamState != STRIP_STREAM_RENDERING || end <= ready || (end - ready < STRIP_CHUNK_LEDS && end < STRIP_LED_COUNT)) {
+		return;
+	}
+
+	if (ready == 0) {
+		sStreamMode = gStripMode;
+	} else if (gStripMode != sStreamMode) {
+		strip_stream_drop();
+		return;
+	}
+
+	strip_pack_range(sStreamFrame, ready, end - ready);
+
+	taskENTER_CRITICAL(&sFrontLock);
+	if (sStreamState == STRIP_STREAM_RENDERING) {
+		sStreamReady = end;
+	}
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	xTaskNotifyGive(sStripTask);
+}
+
+// Settles the open stream, if any, as its frame is published. Returns whether
+// the stream is sending that frame. One that hasn't started yet is dropped,
+// and the frame goes out like any other.
+static bool strip_stream_close(bool streamed) {
+	taskENTER_CRITICAL(&sFrontLock);
+	bool open = sStreamState == STRIP_STREAM_RENDERING;
+	bool delivered = open && streamed && sStreamSending;
+	if (open) {
+		sStreamState = delivered ? STRIP_STREAM_RENDERED : STRIP_STREAM_DROPPED;
+	}
+	bool starved = strip_stream_settle(streamed);
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	if (open || starved) {
+		xTaskNotifyGive(sStripTask);
+	}
+
+	return delivered;
+}
+
+// Hands the LEDs of frame that differ from the last published frame to the
+// strip task. Identical frames are dropped here, so the strip is only re-sent
+// when something actually changed. With a keyframe given, the change is
+// blended in over intervalUs instead.
+static void strip_present(
+	const uint8_t frame[STRIP_LED_COUNT][3],
+	const uint16_t key[STRIP_LED_COUNT][3],
+	enum StripMode keyMode,
+	uint32_t intervalUs) {
+	// A stream delivers the frame itself, as long as it's what was streamed
+	bool delivered = strip_stream_close(key == NULL && memcmp(sStreamFrame, frame, sizeof(sStreamFrame)) == 0);
+
+	size_t start = 0;
+	while (start < STRIP_LED_COUNT && memcmp(frame[start], sFrontFrame[start], sizeof(frame[0])) == 0) {
+		start++;
+	}
+
+	if (start == STRIP_LED_COUNT) {
+		gStripStats.framesUnchanged++;
+		return;
+	}
+
+	size_t end = STRIP_LED_COUNT;
+	while (end > start && memcmp(frame[end - 1], sFrontFrame[end - 1], sizeof(frame[0])) == 0) {
+		end--;
+	}
+
+	taskENTER_CRITICAL(&sFrontLock);
+	if (key != NULL) {
+		strip_push_keyframe(key, keyMode, intervalUs);
+	} else if (sInterpolate) {
+		// The strip may have been left partway through a blend
+		sInterpolate = false;
+		start = 0;
+		end = STRIP_LED_COUNT;
+	}
+
+	gStripFrontSeq++;
+	memcpy(&sFrontFrame[start], &frame[start], (end - start) * sizeof(frame[0]));
+	gStripFrontSeq++;
+	if (!delivered && start < sDirtyStart) {
+		sDirtyStart = start;
+	}
+	if (!delivered && end > sDirtyEnd) {
+		sDirtyEnd = end;
+	}
+	taskEXIT_CRITICAL(&sFrontLock);
+
+	gStripStats.framesChanged++;
+	gStripStats.ledsChanged += end - start;
+
+	xTaskNotifyGive(sStripTask);
+}
+
+// Publishes the frame in gStripData. intervalUs is how long until the next
+// frame, which interpolated output spreads the change over.
+void strip_publish(uint32_t intervalUs) {
+	static uint8_t frame[STRIP_LED_COUNT][3];
+	static uint16_t key[STRIP_LED_COUNT][3];
+
+	strip_pack(frame);
+
+	if (!gStripInterpolate) {
+		strip_present(frame, NULL, gStripMode, intervalUs);
+		return;
+	}
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		key[i][0] = gStripData[i][0] % (gStripMode == STRIP_MODE_HSV ? 360 : 256);
+		key[i][1] = gStripData[i][1] % 256;
+		key[i][2] = gStripData[i][2] % 256;
+	}
+
+	strip_present(frame, key, gStripMode, intervalUs);
+}
+
+// Publishes a frame that was already packed by strip_pack()
+void strip_publish_packed(const uint8_t frame[STRIP_LED_COUNT][3], bool interpolate, uint32_t intervalUs) {
+	static uint16_t key[STRIP_LED_COUNT][3];
+
+	if (!interpolate) {
+		strip_present(frame, NULL, STRIP_MODE_RGB, intervalUs);
+		return;
+	}
+
+	for (size_t i = 0; i < STRIP_LED_COUNT; i++) {
+		key[i][0] = frame[i][0];
+		key[i][1] = frame[i][1];
+		key[i][2] = frame[i][2];
+	}
+
+	strip_present(frame, key, STRIP_MODE_RGB, intervalUs);
+}
+
+// How long a whole frame takes to go out, in microseconds, or 0 if it can't
+// be sent. The strip task owns the RMT channel, so it does the sending.
+uint32_t strip_time_refresh(void) {
+	sTimeRequested = true;
+	xTaskNotifyGive(sStripTask);
+	xSemaphoreTake(sTimeDone, portMAX_DELAY);
+
+	return sTimeUs;
 }
@@ -1,10 +1,25 @@
 #pragma once
 
 #define STRIP_PIN GPIO_NUM_2
-#define STRIP_LED_MODEL LED_MODEL_WS2812
-#define STRIP_LED_COLOR_FORMAT LED_STRIP_COLOR_COMPONENT_FMT_GRB
 #define STRIP_LED_COUNT 300
 
+// WS2812 timing, in ticks of the RMT clock. Each LED takes 24 bits at
+// 1.25 us, and the strip latches once the line stays low for STRIP_RESET_US.
+#define STRIP_RMT_RESOLUTION_HZ 10000000
+#define STRIP_RMT_MEM_BLOCK_SYMBOLS 1024
+#define STRIP_T0H_TICKS 3
+#define STRIP_T0L_TICKS 9
+#define STRIP_T1H_TICKS 9
+#define STRIP_T1L_TICKS 3
+#define STRIP_LED_US 30
+#define STRIP_RESET_US 300
+
+// Frames are sent in chunks, so one can go out while it's still rendering.
+// Sending starts once the render is far enough ahead to stay ahead.
+#define STRIP_CHUNK_LEDS 25
+#define STRIP_CHUNK_COUNT ((STRIP_LED_COUNT + STRIP_CHUNK_LEDS - 1) / STRIP_CHUNK_LEDS)
+#define STRIP_STREAM_MARGIN_US 1000
+
 #define STRIP_TASK_STACK_SIZE_BYTES 0x4000
 #define STRIP_TASK_PRIORITY (configMAX_PRIORITIES - 1)
 #define STRIP_TASK_CORE 1
@@ -14,11 +29,35 @@ enum StripMode {
 	STRIP_MODE_HSV
 };
 
+struct StripStats {
+	uint32_t framesChanged;
+	uint32_t framesUnchanged;
+	uint32_t ledsChanged;
+	uint32_t refreshes;
+	uint32_t interpolatedRefreshes;
+	uint32_t streamedRefreshes;
+	uint32_t streamsDropped;
+	uint32_t sendErrors;
+	uint64_t refreshUs;
+	uint64_t firstRefreshUs;
+};
+
 extern enum StripMode gStripMode;
+extern bool gStripInterpolate;
 extern uint32_t gStripData[STRIP_LED_COUNT][3];
+extern const uint8_t (*const gStripFrontFrame)[3];
+extern volatile uint32_t gStripFrontSeq;
+extern struct StripStats gStripStats;
 
 extern void strip_reset(void);
 extern void strip_init(void);
 extern void strip_start(void);
-extern void strip_suspend(void);
-extern void strip_resume(void);
+extern void strip_pack(uint8_t frame[STRIP_LED_COUNT][3]);
+extern void strip_pack_range(uint8_t (*frame)[3], size_t start, size_t count);
+extern void strip_pack_from(uint8_t (*frame)[3], const uint32_t (*data)[3], enum StripMode mode, size_t start, size_t count);
+extern void strip_publish(uint32_t intervalUs);
+extern void strip_publish_packed(const uint8_t frame[STRIP_LED_COUNT][3], bool interpolate, uint32_t intervalUs);
+extern bool strip_stream_begin(void);
+extern void strip_stream_advance(size_t end);
+extern void strip_stream_drop(void);
+extern uint32_t strip_time_refresh(void);
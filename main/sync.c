@@ -0,0 +1,253 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
+
+#include "sync.h"
+
+#if defined(CONFIG_SYNC_ROLE_LEADER)
+enum SyncRole gSyncRole = SYNC_ROLE_LEADER;
+#elif defined(CONFIG_SYNC_ROLE_FOLLOWER)
+enum SyncRole gSyncRole = SYNC_ROLE_FOLLOWER;
+#else
+enum SyncRole gSyncRole = SYNC_ROLE_NONE;
+#endif
+
+struct SyncStats gSyncStats;
+
+static portMUX_TYPE sSyncLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Shared time is the leader's esp_timer clock. Followers estimate how far
+// theirs is behind from the last few beacons.
+static int64_t sOffset;
+static int64_t sSamples[SYNC_WINDOW];
+static size_t sSampleCount;
+static size_t sSampleNext;
+static int64_t sLastLeaderUs;
+
+static struct SyncAnchor sLocalAnchor;
+static struct SyncAnchor sLeaderAnchor;
+
+// Beacons are big-endian, like bytecode immediates:
+// [magic:u32][version:u8][now:i64][hash:u32][ticks:u32][periodMs:u32][us:i64]
+static size_t sync_put(uint8_t *buf, size_t pos, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		buf[pos + i] = value >> (8 * (size - 1 - i));
+	}
+
+	return pos + size;
+}
+
+static uint64_t sync_get(const uint8_t *buf, size_t *pos, size_t size) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; i++) {
+		value = value << 8 | buf[*pos + i];
+	}
+
+	*pos += size;
+	return value;
+}
+
+static void sync_encode(uint8_t *buf, int64_t now, const struct SyncAnchor *anchor) {
+	size_t pos = 0;
+	pos = sync_put(buf, pos, SYNC_MAGIC, 4);
+	pos = sync_put(buf, pos, SYNC_VERSION, 1);
+	pos = sync_put(buf, pos, now, 8);
+	pos = sync_put(buf, pos, anchor->hash, 4);
+	pos = sync_put(buf, pos, anchor->ticks, 4);
+	pos = sync_put(buf, pos, anchor->periodMs, 4);
+	sync_put(buf, pos, anchor->us, 8);
+}
+
+static bool sync_decode(const uint8_t *buf, size_t len, int64_t *now, struct SyncAnchor *anchor) {
+	if (len != SYNC_PACKET_LEN) {
+		return false;
+	}
+
+	size_t pos = 0;
+	if (sync_get(buf, &pos, 4) != SYNC_MAGIC || sync_get(buf, &pos, 1) != SYNC_VERSION) {
+		return false;
+	}
+
+	*now = sync_get(buf, &pos, 8);
+	anchor->hash = sync_get(buf, &pos, 4);
+	anchor->ticks = sync_get(buf, &pos, 4);
+	anchor->periodMs = sync_get(buf, &pos, 4);
+	anchor->us = sync_get(buf, &pos, 8);
+	return true;
+}
+
+static void sync_sample(int64_t leaderUs, int64_t localUs, const struct SyncAnchor *anchor) {
+	// The leader restarted, and its clock with it
+	if (leaderUs < sLastLeaderUs) {
+		sSampleCount = 0;
+		gSyncStats.resets++;
+	}
+	sLastLeaderUs = leaderUs;
+
+	sSamples[sSampleNext] = leaderUs - localUs;
+	sSampleNext = (sSampleNext + 1) % SYNC_WINDOW;
+	if (sSampleCount < SYNC_WINDOW) {
+		sSampleCount++;
+	}
+
+	// Delivery only ever delays a beacon, so the largest offset seen lately
+	// is the one closest to the truth
+	int64_t offset = INT64_MIN;
+	for (size_t i = 0; i < sSampleCount; i++) {
+		size_t slot = (sSampleNext + SYNC_WINDOW - 1 - i) % SYNC_WINDOW;
+		if (sSamples[slot] > offset) {
+			offset = sSamples[slot];
+		}
+	}
+
+	taskENTER_CRITICAL(&sSyncLock);
+	sOffset = offset;
+	sLeaderAnchor = *anchor;
+	gSyncStats.offsetUs = offset;
+	gSyncStats.lastBeaconUs = localUs;
+	gSyncStats.beaconsReceived++;
+	taskEXIT_CRITICAL(&sSyncLock);
+}
+
+static void sync_lead(int sock) {
+	int enable = 1;
+	setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(SYNC_PORT),
+		.sin_addr.s_addr = htonl(INADDR_BROADCAST)
+	};
+
+	uint8_t buf[SYNC_PACKET_LEN];
+
+	while (true) {
+		taskENTER_CRITICAL(&sSyncLock);
+		struct SyncAnchor anchor = sLocalAnchor;
+		taskEXIT_CRITICAL(&sSyncLock);
+
+		sync_encode(buf, sync_now(), &anchor);
+
+		// Fails until the network is up, the next beacon just tries again
+		if (sendto(sock, buf, sizeof(buf), 0, (struct sockaddr *) &addr, sizeof(addr)) == sizeof(buf)) {
+			gSyncStats.beaconsSent++;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(SYNC_BEACON_INTERVAL_MS));
+	}
+}
+
+static void sync_follow(int sock) {
+	int enable = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(SYNC_PORT),
+		.sin_addr.s_addr = htonl(INADDR_ANY)
+	};
+
+	while (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		vTaskDelay(pdMS_TO_TICKS(SYNC_BEACON_INTERVAL_MS));
+	}
+
+	uint8_t buf[SYNC_PACKET_LEN + 1];
+
+	while (true) {
+		ssize_t len = recv(sock, buf, sizeof(buf), 0);
+		int64_t localUs = esp_timer_get_time();
+
+		int64_t leaderUs;
+		struct SyncAnchor anchor;
+
+		if (len < 0 || !sync_decode(buf, len, &leaderUs, &anchor)) {
+			gSyncStats.beaconsRejected++;
+			continue;
+		}
+
+		sync_sample(leaderUs, localUs, &anchor);
+	}
+}
+
+static void sync_task(void *pvParameters) {
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (sock >= 0) {
+		if (gSyncRole == SYNC_ROLE_LEADER) {
+			sync_lead(sock);
+		} else {
+			sync_follow(sock);
+		}
+
+		close(sock);
+	}
+
+	vTaskDelete(NULL);
+}
+
+void sync_start(void) {
+	if (gSyncRole == SYNC_ROLE_NONE) {
+		return;
+	}
+
+	xTaskCreatePinnedToCore(
+		&sync_task,
+		"sync_task",
+		SYNC_TASK_STACK_SIZE_BYTES,
+		NULL,
+		SYNC_TASK_PRIORITY,
+		NULL,
+		SYNC_TASK_CORE);
+}
+
+// Until the first beacon arrives, a follower's shared time is its own clock
+int64_t sync_now(void) {
+	taskENTER_CRITICAL(&sSyncLock);
+	int64_t offset = sOffset;
+	taskEXIT_CRITICAL(&sSyncLock);
+
+	return esp_timer_get_time() + offset;
+}
+
+bool sync_locked(void) {
+	if (gSyncRole != SYNC_ROLE_FOLLOWER) {
+		return gSyncRole == SYNC_ROLE_LEADER;
+	}
+
+	taskENTER_CRITICAL(&sSyncLock);
+	bool heard = gSyncStats.beaconsReceived > 0;
+	int64_t last = gSyncStats.lastBeaconUs;
+	taskEXIT_CRITICAL(&sSyncLock);
+
+	return heard && esp_timer_get_time() - last < SYNC_TIMEOUT_MS * 1000;
+}
+
+void sync_set_anchor(const struct SyncAnchor *anchor) {
+	taskENTER_CRITICAL(&sSyncLock);
+	sLocalAnchor = *anchor;
+	taskEXIT_CRITICAL(&sSyncLock);
+}
+
+// Returns false unless a leader has been heard from recently
+bool sync_leader_anchor(struct SyncAnchor *anchor) {
+	if (gSyncRole != SYNC_ROLE_FOLLOWER || !sync_locked()) {
+		return false;
+	}
+
+	taskENTER_CRITICAL(&sSyncLock);
+	*anchor = sLeaderAnchor;
+	taskEXIT_CRITICAL(&sSyncLock);
+
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#define SYNC_PORT 4210
+#define SYNC_MAGIC 0x424C4B53
+#define SYNC_VERSION 1
+#define SYNC_PACKET_LEN 33
+#define SYNC_BEACON_INTERVAL_MS 250
+#define SYNC_TIMEOUT_MS 2000
+#define SYNC_WINDOW 8
+#define SYNC_MAX_LEAD_FRAMES 4
+
+#define SYNC_TASK_STACK_SIZE_BYTES 0x1000
+#define SYNC_TASK_PRIORITY 2
+#define SYNC_TASK_CORE 1
+
+enum SyncRole {
+	SYNC_ROLE_NONE,
+	SYNC_ROLE_LEADER,
+	SYNC_ROLE_FOLLOWER
+};
+
+// Where a program's frame schedule is pinned: tick `ticks` is shown at `us`
+// in shared time, and each following tick periodMs later. Controllers
+// running the same program (by hash) adopt the leader's anchor.
+struct SyncAnchor {
+	uint32_t hash;
+	uint32_t ticks;
+	uint32_t periodMs;
+	int64_t us;
+};
+
+struct SyncStats {
+	uint32_t beaconsSent;
+	uint32_t beaconsReceived;
+	uint32_t beaconsRejected;
+	uint32_t resets;
+	int64_t offsetUs;
+	int64_t lastBeaconUs;
+};
+
+extern enum SyncRole gSyncRole;
+extern struct SyncStats gSyncStats;
+
+extern void sync_start(void);
+extern int64_t sync_now(void);
+extern bool sync_locked(void);
+extern void sync_set_anchor(const struct SyncAnchor *anchor);
+extern bool sync_leader_anchor(struct SyncAnchor *anchor);
@@ -7,18 +7,45 @@
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_wifi.h"
-#include "nvs_flash.h"
 
 #include "sdkconfig.h"
 
+#include "sync.h"
 #include "wifi.h"
 
-void wifi_init(void) {
-	nvs_flash_init();
+// Followers keep trying to reach the leader for as long as they're up
+static void wifi_sta_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+	if (id == WIFI_EVENT_STA_START || id == WIFI_EVENT_STA_DISCONNECTED) {
+		esp_wifi_connect();
+	}
+}
 
-	esp_event_loop_create_default();
+static void wifi_init_sta(void) {
+	esp_netif_create_default_wifi_sta();
 
-	esp_netif_init();
+	wifi_init_config_t wifiInitCfg = WIFI_INIT_CONFIG_DEFAULT();
+	esp_wifi_init(&wifiInitCfg);
+
+	esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_sta_handler, NULL);
+
+	wifi_config_t wifiCfg = {
+		.sta = {
+			.ssid = CONFIG_WIFI_SSID,
+			.password = CONFIG_WIFI_PASS,
+			.channel = CONFIG_WIFI_CHANNEL
+		}
+	};
+	esp_wifi_set_mode(WIFI_MODE_STA);
+	esp_wifi_set_config(WIFI_IF_STA, &wifiCfg);
+
+	esp_wifi_start();
+
+	// Power save holds broadcasts back until the next DTIM beacon, which
+	// would throw the clock estimate off by up to a few hundred ms
+	esp_wifi_set_ps(WIFI_PS_NONE);
+}
+
+static void wifi_init_ap(void) {
 	esp_netif_create_default_wifi_ap();
 
 	wifi_init_config_t wifiInitCfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -38,3 +65,16 @@ void wifi_init(void) {
 
 	esp_wifi_start();
 }
+
+// Expects NVS to be initialized already, see storage_init
+void wifi_init(void) {
+	esp_event_loop_create_default();
+
+	esp_netif_init();
+
+	if (gSyncRole == SYNC_ROLE_FOLLOWER) {
+		wifi_init_sta();
+	} else {
+		wifi_init_ap();
+	}
+}
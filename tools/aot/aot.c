@@ -0,0 +1,679 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bytecode.h"
+
+#define AOT_MAX_OPERANDS 5
+
+struct AotOp {
+	const char *name;
+	const char *operands;
+};
+
+#define OP(opcode, func, operands) [opcode] = { #func, operands },
+#define OP_INT(opcode, func, operands) [opcode] = { #func, operands },
+#define OP_ALIAS(opcode, func)
+#define OP_NONE(opcode)
+
+static const struct AotOp sOps[256] = {
+#include "files/ops.h"
+};
+
+#undef OP
+#undef OP_INT
+#undef OP_ALIAS
+#undef OP_NONE
+
+struct AotEffect {
+	const char *name;
+	const uint8_t *bytecode;
+	size_t len;
+};
+
+#define EFFECT(name, ...) { #name, (const uint8_t []) { __VA_ARGS__ }, sizeof((const uint8_t []) { __VA_ARGS__ }) },
+
+static const struct AotEffect sEffects[] = {
+#include "effects.h"
+};
+
+#undef EFFECT
+
+// What an immediate operand has to satisfy for the template to apply
+enum AotGuard {
+	AOT_GUARD_NONE,
+	AOT_GUARD_NONZERO,
+	AOT_GUARD_INT_NONZERO,
+	AOT_GUARD_MEMORY
+};
+
+// The C an instruction becomes, the same as its handler in bytecode.c. $0-$4
+// stand for the operands: registers as vm->registers/vm->intRegisters,
+// immediates as literals. Instructions without a template call the handler
+// itself.
+static const struct {
+	const char *name;
+	const char *code;
+	enum AotGuard guard;
+} sTemplates[] = {
+	{ "nop", "" },
+	{ "rgb", "*vm->stripMode = STRIP_MODE_RGB;" },
+	{ "hsv", "*vm->stripMode = STRIP_MODE_HSV;" },
+	{ "periodi", "vm->periodMs = (uint32_t) $0;" },
+	{ "periodr", "vm->periodMs = (uint32_t) $0;" },
+	{ "redi", "vm->strip[vm->curLed][0] = (uint32_t) $0;" },
+	{ "greeni", "vm->strip[vm->curLed][1] = (uint32_t) $0;" },
+	{ "bluei", "vm->strip[vm->curLed][2] = (uint32_t) $0;" },
+	{ "redr", "vm->strip[vm->curLed][0] = (uint32_t) $0;" },
+	{ "greenr", "vm->strip[vm->curLed][1] = (uint32_t) $0;" },
+	{ "bluer", "vm->strip[vm->curLed][2] = (uint32_t) $0;" },
+	{ "getpos", "$0 = (float) (vm->curLed - vm->ledStart);" },
+	{ "getposend", "$0 = (float) (vm->ledStart + vm->ledCount - vm->curLed);" },
+	{ "getticks", "$0 = (float) bc_ticks(vm);" },
+	{ "getrng", "vm->impure = true;\n$0 = (float) vm->rng / 0xFFFFFFFFU;" },
+	{ "getnumleds", "$0 = vm->ledCount;" },
+	{ "movi", "$0 = $1;" },
+	{ "movr", "$0 = $1;" },
+	{ "addi", "$0 = $1 + $2;" },
+	{ "addr", "$0 = $1 + $2;" },
+	{ "subr", "$0 = $1 - $2;" },
+	{ "muli", "$0 = $1 * $2;" },
+	{ "mulr", "$0 = $1 * $2;" },
+	{ "divi", "$0 = $1 / $2;", AOT_GUARD_NONZERO },
+	{ "divr", "if ($2 == 0.0f) {\n\tERROR(\"divr by zero\");\n\treturn;\n}\n$0 = $1 / $2;" },
+	{ "modi", "$0 = (float) ((int32_t) $1 % (int32_t) $2);", AOT_GUARD_INT_NONZERO },
+	{ "remi", "$0 = (float) (((int32_t) $1 % (int32_t) $2 + (int32_t) $2) % (int32_t) $2);", AOT_GUARD_INT_NONZERO },
+	{ "sinr", "$0 = sinf($1);" },
+	{ "cosr", "$0 = cosf($1);" },
+	{ "tanr", "$0 = tanf($1);" },
+	{ "asinr", "$0 = asinf($1);" },
+	{ "acosr", "$0 = acosf($1);" },
+	{ "atanr", "$0 = atanf($1);" },
+	{ "atan2r", "$0 = atan2f($1, $2);" },
+	{ "sqrtr", "$0 = sqrtf($1);" },
+	{ "floorr", "$0 = floorf($1);" },
+	{ "ceilr", "$0 = ceilf($1);" },
+	{ "roundr", "$0 = roundf($1);" },
+	{ "mini", "$0 = $1 < $2 ? $1 : $2;" },
+	{ "minr", "$0 = $1 < $2 ? $1 : $2;" },
+	{ "maxi", "$0 = $1 > $2 ? $1 : $2;" },
+	{ "maxr", "$0 = $1 > $2 ? $1 : $2;" },
+	{ "clampi", "$0 = $1 < $2 ? $2 : $1 > $3 ? $3 : $1;" },
+	{ "absr", "$0 = fabsf($1);" },
+	{ "getcmp", "$0 = (float) vm->compare;" },
+	{ "cz", "vm->compare = $0 == 0.0f;" },
+	{ "cnz", "vm->compare = $0 != 0.0f;" },
+	{ "ceqi", "vm->compare = $0 == $1;" },
+	{ "ceqr", "vm->compare = $0 == $1;" },
+	{ "clti", "vm->compare = $0 < $1;" },
+	{ "cltr", "vm->compare = $0 < $1;" },
+	{ "clei", "vm->compare = $0 <= $1;" },
+	{ "cler", "vm->compare = $0 <= $1;" },
+	{ "cgti", "vm->compare = $0 > $1;" },
+	{ "cgtr", "vm->compare = $0 > $1;" },
+	{ "cgei", "vm->compare = $0 >= $1;" },
+	{ "cger", "vm->compare = $0 >= $1;" },
+	{ "loadi", "$0 = vm->memory[(size_t) $1];", AOT_GUARD_MEMORY },
+	{ "storei", "vm->impure = true;\nvm->memory[(size_t) $1] = $0;", AOT_GUARD_MEMORY },
+	{ "fsinr", "$0 = bc_fast_sin($1);" },
+	{ "fcosr", "$0 = bc_fast_cos($1);" },
+	{ "ftanr", "$0 = bc_fast_sin($1) / bc_fast_cos($1);" },
+	{ "fatan2r", "$0 = bc_fast_atan2($1, $2);" },
+	{ "fsqrtr", "$0 = bc_fast_sqrt($1);" },
+	{ "imovi", "$0 = $1;" },
+	{ "imovr", "$0 = $1;" },
+	{ "iaddi", "$0 = (int32_t) ((uint32_t) $1 + (uint32_t) $2);" },
+	{ "iaddr", "$0 = (int32_t) ((uint32_t) $1 + (uint32_t) $2);" },
+	{ "isubr", "$0 = (int32_t) ((uint32_t) $1 - (uint32_t) $2);" },
+	{ "imuli", "$0 = (int32_t) ((uint32_t) $1 * (uint32_t) $2);" },
+	{ "imulr", "$0 = (int32_t) ((uint32_t) $1 * (uint32_t) $2);" },
+	{ "idivi", "$0 = bc_int_div($1, $2);", AOT_GUARD_NONZERO },
+	{ "imodi", "$0 = bc_int_mod($1, $2);", AOT_GUARD_NONZERO },
+	{ "iremi", "$0 = bc_int_rem($1, $2);", AOT_GUARD_NONZERO },
+	{ "iandi", "$0 = $1 & $2;" },
+	{ "iandr", "$0 = $1 & $2;" },
+	{ "iori", "$0 = $1 | $2;" },
+	{ "iorr", "$0 = $1 | $2;" },
+	{ "ixori", "$0 = $1 ^ $2;" },
+	{ "ixorr", "$0 = $1 ^ $2;" },
+	{ "inotr", "$0 = ~$1;" },
+	{ "ishli", "$0 = (int32_t) ((uint32_t) $1 << ($2 & 31));" },
+	{ "ishri", "$0 = (int32_t) ((uint32_t) $1 >> ($2 & 31));" },
+	{ "isari", "$0 = $1 >> ($2 & 31);" },
+	{ "iceqi", "vm->compare = $0 == $1;" },
+	{ "iceqr", "vm->compare = $0 == $1;" },
+	{ "iclti", "vm->compare = $0 < $1;" },
+	{ "icltr", "vm->compare = $0 < $1;" },
+	{ "iclei", "vm->compare = $0 <= $1;" },
+	{ "icler", "vm->compare = $0 <= $1;" },
+	{ "icgti", "vm->compare = $0 > $1;" },
+	{ "icgtr", "vm->compare = $0 > $1;" },
+	{ "icgei", "vm->compare = $0 >= $1;" },
+	{ "icger", "vm->compare = $0 >= $1;" },
+	{ "itof", "$0 = (float) $1;" },
+	{ "ftoi", "$0 = (int32_t) $1;" },
+	{ "igetticks", "$0 = (int32_t) bc_ticks(vm);" },
+	{ "igetpos", "$0 = (int32_t) (vm->curLed - vm->ledStart);" },
+	{ "iredr", "vm->strip[vm->curLed][0] = (uint32_t) $0;" },
+	{ "igreenr", "vm->strip[vm->curLed][1] = (uint32_t) $0;" },
+	{ "ibluer", "vm->strip[vm->curLed][2] = (uint32_t) $0;" }
+};
+
+struct AotInstr {
+	size_t at;
+	size_t size;
+	uint8_t opcode;
+	uint32_t operands[AOT_MAX_OPERANDS];
+};
+
+struct AotProgram {
+	const char *name;
+	const uint8_t *bytecode;
+	size_t len;
+	struct AotInstr instrs[BC_MAX_LEN];
+	size_t count;
+	bool targets[BC_MAX_LEN];
+	bool regs[256];
+	bool intRegs[256];
+	bool random;
+	char error[128];
+};
+
+static void aot_usage(void) {
+	fprintf(stderr,
+		"usage: aot [-o out.h] [-n name program.bin]\n"
+		"  -o  write to a file instead of stdout\n"
+		"  -n  translate program.bin to a function bc_native_<name>\n"
+		"Without a program, translates the effects in effects.h, which is how\n"
+		"main/effects_native.h is made.\n");
+}
+
+// FNV-1a, like bc_hash
+static uint32_t aot_hash(const uint8_t *data, size_t len) {
+	uint32_t hash = 0x811C9DC5;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 0x01000193;
+	}
+
+	return hash;
+}
+
+static float aot_f32(uint32_t bits) {
+	union {
+		uint32_t i;
+		float f;
+	} cast = { .i = bits };
+
+	return cast.f;
+}
+
+// Like bc_len, without the padding it gets to look past the end
+static size_t aot_len(const uint8_t *bytecode, size_t size) {
+	size_t run = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		run = bytecode[i] == 0xFF ? run + 1 : 0;
+		if (run == 8) {
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+// Splits the program into instructions. Jumps have to land on one, or on the
+// end marker, which runs as a halt.
+static bool aot_decode(struct AotProgram *program) {
+	const uint8_t *bytecode = program->bytecode;
+	size_t end = program->len - 8;
+	size_t pc = 2;
+
+	while (pc < end) {
+		struct AotInstr *instr = &program->instrs[program->count++];
+		instr->at = pc;
+		instr->opcode = bytecode[pc++];
+
+		const struct AotOp *op = &sOps[instr->opcode];
+		if (op->name == NULL) {
+			snprintf(program->error, sizeof(program->error), "invalid opcode %02x at %04zx", instr->opcode, instr->at);
+			return false;
+		}
+
+		for (size_t i = 0; op->operands[i] != '\0'; i++) {
+			char operand = op->operands[i];
+			size_t size = operand == 'r' || operand == 'x' ? 1 : 4;
+
+			if (pc + size > end) {
+				snprintf(program->error, sizeof(program->error), "truncated instruction at %04zx", instr->at);
+				return false;
+			}
+
+			uint32_t value = bytecode[pc];
+			if (size == 4) {
+				value = (uint32_t) bytecode[pc] << 24 | bytecode[pc + 1] << 16 | bytecode[pc + 2] << 8 | bytecode[pc + 3];
+			}
+
+			if (operand == 'r') {
+				program->regs[value] = true;
+			} else if (operand == 'x') {
+				program->intRegs[value] = true;
+			}
+
+			instr->operands[i] = value;
+			pc += size;
+		}
+
+		instr->size = pc - instr->at;
+
+		if (strcmp(op->name, "getrng") == 0) {
+			program->random = true;
+		}
+	}
+
+	for (size_t i = 0; i < program->count; i++) {
+		const struct AotInstr *instr = &program->instrs[i];
+		const char *operands = sOps[instr->opcode].operands;
+
+		for (size_t j = 0; operands[j] != '\0'; j++) {
+			uint32_t target = instr->operands[j];
+			if (operands[j] != 'a') {
+				continue;
+			}
+
+			if (target >= program->len) {
+				snprintf(program->error, sizeof(program->error), "jump target %04" PRIx32 " out of range at %04zx", target, instr->at);
+				return false;
+			}
+
+			bool start = target >= end;
+			for (size_t k = 0; k < program->count && !start; k++) {
+				start = program->instrs[k].at == target;
+			}
+
+			if (!start) {
+				snprintf(program->error, sizeof(program->error), "jump into an instruction at %04zx", instr->at);
+				return false;
+			}
+
+			program->targets[target < end ? target : end] = true;
+		}
+	}
+
+	return true;
+}
+
+static void aot_literal(char *buf, size_t size, char operand, uint32_t value) {
+	if (operand == 'f') {
+		char num[32];
+		snprintf(num, sizeof(num), "%.9g", aot_f32(value));
+
+		bool plain = strpbrk(num, ".e") == NULL;
+		snprintf(buf, size, aot_f32(value) < 0.0f ? "(%s%sf)" : "%s%sf", num, plain ? ".0" : "");
+	} else if ((int32_t) value == INT32_MIN) {
+		snprintf(buf, size, "INT32_MIN");
+	} else {
+		snprintf(buf, size, "%" PRId32, (int32_t) value);
+	}
+}
+
+// Immediates are folded in as constants, so the template only applies when
+// the handler would do the same thing with them at runtime
+static bool aot_applies(const char *code, enum AotGuard guard, const char *operands, const uint32_t *values) {
+	size_t last = 0;
+
+	for (size_t i = 0; operands[i] != '\0'; i++) {
+		char cast[48];
+
+		if (operands[i] != 'f') {
+			if (operands[i] == 'd') {
+				last = i;
+			}
+			continue;
+		}
+
+		last = i;
+		float imm = aot_f32(values[i]);
+		if (!isfinite(imm)) {
+			return false;
+		}
+
+		snprintf(cast, sizeof(cast), "(uint32_t) $%zu", i);
+		if (strstr(code, cast) != NULL && !(imm >= 0.0f && imm < 4294967296.0f)) {
+			return false;
+		}
+
+		snprintf(cast, sizeof(cast), "(int32_t) $%zu", i);
+		if (strstr(code, cast) != NULL && !(imm >= -2147483648.0f && imm < 2147483648.0f)) {
+			return false;
+		}
+	}
+
+	switch (guard) {
+		case AOT_GUARD_NONE:
+			return true;
+
+		case AOT_GUARD_NONZERO:
+			return operands[last] == 'f' ? aot_f32(values[last]) != 0.0f : values[last] != 0;
+
+		case AOT_GUARD_INT_NONZERO:
+			return (int32_t) aot_f32(values[last]) != 0;
+
+		case AOT_GUARD_MEMORY:
+			return aot_f32(values[last]) >= 0.0f && aot_f32(values[last]) < BC_MEMORY_SIZE;
+	}
+
+	return false;
+}
+
+static void aot_emit_code(FILE *out, const char *code, const char *operands, const uint32_t *values) {
+	fputc('\t', out);
+
+	for (const char *c = code; *c != '\0'; c++) {
+		if (*c == '\n') {
+			fputs("\n\t", out);
+		} else if (*c == '$') {
+			size_t i = *++c - '0';
+			char operand = operands[i];
+
+			if (operand == 'r') {
+				fprintf(out, "vm->registers[%" PRIu32 "]", values[i]);
+			} else if (operand == 'x') {
+				fprintf(out, "vm->intRegisters[%" PRIu32 "]", values[i]);
+			} else {
+				char literal[48];
+				aot_literal(literal, sizeof(literal), operand, values[i]);
+				fputs(literal, out);
+			}
+		} else {
+			fputc(*c, out);
+		}
+	}
+
+	fputc('\n', out);
+}
+
+static void aot_emit_comment(FILE *out, const struct AotInstr *instr) {
+	const struct AotOp *op = &sOps[instr->opcode];
+
+	fprintf(out, "\t// %02zX: %s", instr->at, op->name);
+
+	for (size_t i = 0; op->operands[i] != '\0'; i++) {
+		char literal[48];
+
+		switch (op->operands[i]) {
+			case 'r':
+				fprintf(out, " r%" PRIu32, instr->operands[i]);
+				break;
+
+			case 'x':
+				fprintf(out, " i%" PRIu32, instr->operands[i]);
+				break;
+
+			case 'a':
+				fprintf(out, " %02" PRIX32, instr->operands[i]);
+				break;
+
+			default:
+				aot_literal(literal, sizeof(literal), op->operands[i], instr->operands[i]);
+				fprintf(out, " %s", literal);
+				break;
+		}
+	}
+
+	fputc('\n', out);
+}
+
+// Instructions are counted a straight run at a time, and the count only
+// checked against BC_MAX_INSTRS on backward jumps, the only way to exceed it
+static void aot_emit_count(FILE *out, size_t *pending) {
+	if (*pending == 0) {
+		return;
+	}
+
+	fprintf(out, "\tvm->instrs += %zu;\n", *pending);
+	*pending = 0;
+}
+
+static void aot_emit_jump(FILE *out, const char *cond, const struct AotInstr *instr, size_t target, size_t end) {
+	const char *indent = cond != NULL ? "\t\t" : "\t";
+
+	if (cond != NULL) {
+		fprintf(out, "\tif (%s) {\n", cond);
+	}
+
+	if (target <= instr->at) {
+		fprintf(out, "%sif (bc_native_yield(vm)) {\n%s\treturn;\n%s}\n", indent, indent, indent);
+	}
+
+	if (target >= end) {
+		fprintf(out, "%sgoto end;\n", indent);
+	} else {
+		fprintf(out, "%sgoto L%04zX;\n", indent, target);
+	}
+
+	if (cond != NULL) {
+		fprintf(out, "\t}\n");
+	}
+}
+
+static bool aot_translate(FILE *out, struct AotProgram *program) {
+	if (!aot_decode(program)) {
+		return false;
+	}
+
+	size_t end = program->len - 8;
+
+	fprintf(out, "// %s, %zu bytes, hash %08" PRIX32 "\n", program->name, program->len, aot_hash(program->bytecode, program->len));
+	fprintf(out, "static void bc_native_%s(struct BytecodeVm *vm) {\n", program->name);
+
+	// Registers start out cleared, like bc_execute leaves them
+	bool cleared = false;
+	for (size_t i = 0; i < 256; i++) {
+		if (program->regs[i]) {
+			fprintf(out, "\tvm->registers[%zu] = 0.0f;\n", i);
+			cleared = true;
+		}
+	}
+	for (size_t i = 0; i < 256; i++) {
+		if (program->intRegs[i]) {
+			fprintf(out, "\tvm->intRegisters[%zu] = 0;\n", i);
+			cleared = true;
+		}
+	}
+
+	size_t pending = 0;
+
+	for (size_t i = 0; i < program->count; i++) {
+		const struct AotInstr *instr = &program->instrs[i];
+		const struct AotOp *op = &sOps[instr->opcode];
+
+		if (program->targets[instr->at]) {
+			aot_emit_count(out, &pending);
+			fprintf(out, "%sL%04zX:\n", cleared || i > 0 ? "\n" : "", instr->at);
+		} else if (cleared || i > 0) {
+			fputc('\n', out);
+		}
+
+		aot_emit_comment(out, instr);
+		pending++;
+
+		bool jump = strcmp(op->name, "goto") == 0 || strcmp(op->name, "jt") == 0 || strcmp(op->name, "jf") == 0;
+		bool halt = strcmp(op->name, "halt") == 0 || strcmp(op->name, "haltt") == 0 || strcmp(op->name, "haltf") == 0;
+
+		// The interpreter steps the generator after every instruction, so a
+		// program that reads it does the same
+		if (jump || halt) {
+			aot_emit_count(out, &pending);
+			if (program->random) {
+				fprintf(out, "\tbc_update_rng(vm);\n");
+			}
+		}
+
+		if (jump) {
+			const char *cond = op->name[1] == 't' ? "vm->compare" : op->name[1] == 'f' ? "!vm->compare" : NULL;
+			aot_emit_jump(out, cond, instr, instr->operands[0], end);
+			continue;
+		}
+
+		if (halt) {
+			const char *cond = op->name[4] == 't' ? "vm->compare" : op->name[4] == 'f' ? "!vm->compare" : NULL;
+			if (cond != NULL) {
+				fprintf(out, "\tif (%s) {\n\t\treturn;\n\t}\n", cond);
+			} else {
+				fprintf(out, "\treturn;\n");
+			}
+			continue;
+		}
+
+		const char *code = NULL;
+		for (size_t j = 0; j < sizeof(sTemplates) / sizeof(sTemplates[0]); j++) {
+			if (strcmp(sTemplates[j].name, op->name) == 0 &&
+				aot_applies(sTemplates[j].code, sTemplates[j].guard, op->operands, instr->operands)) {
+				code = sTemplates[j].code;
+				break;
+			}
+		}
+
+		if (code != NULL) {
+			if (code[0] != '\0') {
+				aot_emit_code(out, code, op->operands, instr->operands);
+			}
+		} else {
+			fprintf(out, "\tvm->pc = 0x%02zX;\n\tbc_op_%s(vm);\n\tif (!vm->running) {\n\t\treturn;\n\t}\n", instr->at + 1, op->name);
+		}
+
+		if (program->random) {
+			fprintf(out, "\tbc_update_rng(vm);\n");
+		}
+	}
+
+	// Running into the end marker executes it, as a halt
+	if (program->targets[end]) {
+		aot_emit_count(out, &pending);
+		fprintf(out, "%send:\n", cleared || program->count > 0 ? "\n" : "");
+	}
+
+	pending++;
+	aot_emit_count(out, &pending);
+	if (program->random) {
+		fprintf(out, "\tbc_update_rng(vm);\n");
+	}
+	fprintf(out, "}\n");
+
+	return true;
+}
+
+static bool aot_effects(FILE *out) {
+	static struct AotProgram program;
+	size_t count = sizeof(sEffects) / sizeof(sEffects[0]);
+
+	fprintf(out,
+		"// Generated by tools/aot from effects.h, don't edit. Native versions of\n"
+		"// the stock effects, each the same as interpreting its bytecode.\n");
+
+	for (size_t i = 0; i < count; i++) {
+		memset(&program, 0, sizeof(program));
+		program.name = sEffects[i].name;
+		program.bytecode = sEffects[i].bytecode;
+		program.len = aot_len(sEffects[i].bytecode, sEffects[i].len);
+
+		if (program.len == 0) {
+			fprintf(stderr, "aot: %s: missing end marker\n", program.name);
+			return false;
+		}
+
+		fputc('\n', out);
+		if (!aot_translate(out, &program)) {
+			fprintf(stderr, "aot: %s: %s\n", program.name, program.error);
+			return false;
+		}
+	}
+
+	// bc_native_find only trusts a function if its effect still hashes the same
+	fprintf(out, "\nstatic const struct NativeEffect sNativeEffects[BC_EFFECT_COUNT] = {\n");
+	for (size_t i = 0; i < count; i++) {
+		size_t len = aot_len(sEffects[i].bytecode, sEffects[i].len);
+		fprintf(out, "\t{ 0x%08" PRIX32 ", bc_native_%s }%s\n", aot_hash(sEffects[i].bytecode, len), sEffects[i].name, i + 1 < count ? "," : "");
+	}
+	fprintf(out, "};\n");
+
+	return true;
+}
+
+static bool aot_file(FILE *out, const char *name, const char *path) {
+	static struct AotProgram program;
+	static uint8_t bytecode[BC_MAX_LEN];
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "aot: can't read %s\n", path);
+		return false;
+	}
+
+	size_t size = fread(bytecode, 1, sizeof(bytecode), file);
+	fclose(file);
+
+	memset(&program, 0, sizeof(program));
+	program.name = name;
+	program.bytecode = bytecode;
+	program.len = aot_len(bytecode, size);
+
+	if (program.len == 0) {
+		fprintf(stderr, "aot: %s: missing end marker\n", path);
+		return false;
+	}
+
+	if (!aot_translate(out, &program)) {
+		fprintf(stderr, "aot: %s: %s\n", path, program.error);
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const char *outPath = NULL;
+	const char *name = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:n:")) != -1) {
+		switch (opt) {
+			case 'o':
+				outPath = optarg;
+				break;
+
+			case 'n':
+				name = optarg;
+				break;
+
+			default:
+				aot_usage();
+				return 2;
+		}
+	}
+
+	if ((name == NULL) != (optind == argc) || argc - optind > 1) {
+		aot_usage();
+		return 2;
+	}
+
+	FILE *out = outPath != NULL ? fopen(outPath, "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "aot: can't write %s\n", outPath);
+		return 1;
+	}
+
+	bool ok = name != NULL ? aot_file(out, name, argv[optind]) : aot_effects(out);
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+typedef struct rmt_channel *rmt_channel_handle_t;
+typedef struct rmt_encoder *rmt_encoder_handle_t;
+
+#define GPIO_NUM_2 2
+#define RMT_CLK_SRC_DEFAULT 0
+
+typedef struct {
+	uint16_t duration0 : 15;
+	uint16_t level0 : 1;
+	uint16_t duration1 : 15;
+	uint16_t level1 : 1;
+} rmt_symbol_word_t;
+
+typedef struct {
+	int gpio_num;
+	int clk_src;
+	uint32_t resolution_hz;
+	size_t mem_block_symbols;
+	size_t trans_queue_depth;
+	struct {
+		uint32_t with_dma : 1;
+	} flags;
+} rmt_tx_channel_config_t;
+
+typedef struct {
+	rmt_symbol_word_t bit0;
+	rmt_symbol_word_t bit1;
+	struct {
+		uint32_t msb_first : 1;
+	} flags;
+} rmt_bytes_encoder_config_t;
+
+typedef struct {
+	size_t num_symbols;
+} rmt_tx_done_event_data_t;
+
+typedef struct {
+	bool (*on_trans_done)(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *event, void *arg);
+} rmt_tx_event_callbacks_t;
+
+typedef struct {
+	int loop_count;
+} rmt_transmit_config_t;
+
+extern esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *channel);
+extern esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *encoder);
+extern esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t channel, const rmt_tx_event_callbacks_t *callbacks, void *arg);
+extern esp_err_t rmt_enable(rmt_channel_handle_t channel);
+extern esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *data, size_t len, const rmt_transmit_config_t *config);
+extern esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t channel, int timeoutMs);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+typedef struct esp_timer *esp_timer_handle_t;
+
+typedef struct {
+	void (*callback)(void *arg);
+	void *arg;
+	const char *name;
+} esp_timer_create_args_t;
+
+extern int64_t esp_timer_get_time(void);
+extern esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer);
+extern esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+extern esp_err_t esp_timer_stop(esp_timer_handle_t timer);
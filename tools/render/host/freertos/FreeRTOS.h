@@ -0,0 +1,40 @@
+#pragma once
+
+// Just enough of FreeRTOS for the firmware sources to build and run on a
+// single host thread. Nothing here ever blocks.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+	int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xFFFFFFFF
+
+#define configMAX_PRIORITIES 25
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+#define taskENTER_CRITICAL(mux) ((void) (mux))
+#define taskEXIT_CRITICAL(mux) ((void) (mux))
+
+extern BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *task, BaseType_t core);
+extern void vTaskDelete(TaskHandle_t task);
+extern void vTaskDelay(TickType_t ticks);
+extern BaseType_t xTaskNotifyGive(TaskHandle_t task);
+extern BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks);
+extern BaseType_t xTaskNotifyStateClear(TaskHandle_t task);
+extern uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
@@ -0,0 +1,6 @@
+#pragma once
+
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+extern SemaphoreHandle_t xSemaphoreCreateBinary(void);
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "driver/rmt_tx.h"
+#include "esp_timer.h"
+
+// Tasks are never started on the host, the renderer calls straight into
+// bytecode.c instead
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *task, BaseType_t core) {
+	return pdFALSE;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+	return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks) {
+	return pdFALSE;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t task) {
+	return pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+	return 0;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+	static int semaphore;
+	return &semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+	static int semaphore;
+	return &semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	return pdTRUE;
+}
+
+// Added to the clock, so tests can run controllers whose clocks disagree
+int64_t gHostClockSkewUs;
+
+int64_t esp_timer_get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + gHostClockSkewUs;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer) {
+	*timer = NULL;
+	return 0;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+	return 0;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+	return 0;
+}
+
+// Only the on-device benchmark counts cycles
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (esp_cpu_cycle_count_t) ((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+	return malloc(size);
+}
+
+void heap_caps_free(void *ptr) {
+	free(ptr);
+}
+
+// The strip is never driven on the host either
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *channel) {
+	*channel = NULL;
+	return 0;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *encoder) {
+	*encoder = NULL;
+	return 0;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t channel, const rmt_tx_event_callbacks_t *callbacks, void *arg) {
+	return 0;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+	return 0;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *data, size_t len, const rmt_transmit_config_t *config) {
+	return 0;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t channel, int timeoutMs) {
+	return 0;
+}
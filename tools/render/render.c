@@ -0,0 +1,553 @@
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "strip.h"
+#include "bytecode.h"
+#include "layout.h"
+
+#define RENDER_DEFAULT_FRAMES 1000
+#define RENDER_FRAME_LEN (STRIP_LED_COUNT * 3)
+#define RENDER_FRAMES_MAGIC "BLKF"
+#define RENDER_PNG_BLOCK_LEN 0xFFFF
+
+struct RenderOptions {
+	uint32_t frames;
+	const char *output;
+	bool check;
+	bool update;
+	bool interpret;
+};
+
+struct RenderOutput {
+	uint8_t *frames;
+	uint32_t *hashes;
+	uint32_t count;
+};
+
+static void render_usage(void) {
+	fprintf(stderr,
+		"usage: render [-n frames] [-o out.png|out.frames] [-l layout.bin] [-g | -u] [-i] program.bin|dir...\n"
+		"       render [-n frames] [-l layout.bin] -e\n"
+		"  -n  ticks to render, %d by default\n"
+		"  -o  write the frames as a PNG strip (one row per tick) or raw frames\n"
+		"  -l  LED layout, as served by /layout.bin\n"
+		"  -g  compare per-frame hashes against program.golden\n"
+		"  -u  write program.golden from this render\n"
+		"  -i  interpret stock effects instead of running their native code\n"
+		"  -e  check each stock effect's native code against the interpreter\n"
+		"Directories are searched for *.bin programs.\n",
+		RENDER_DEFAULT_FRAMES);
+}
+
+// FNV-1a, like bc_hash
+static uint32_t render_hash(const uint8_t *data, size_t len) {
+	uint32_t hash = 0x811C9DC5;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 0x01000193;
+	}
+
+	return hash;
+}
+
+static void render_frame(const uint8_t (*data)[3], void *arg) {
+	struct RenderOutput *output = arg;
+
+	if (output->frames != NULL) {
+		memcpy(&output->frames[(size_t) output->count * RENDER_FRAME_LEN], data, RENDER_FRAME_LEN);
+	}
+
+	output->hashes[output->count++] = render_hash((const uint8_t *) data, RENDER_FRAME_LEN);
+}
+
+static bool render_read(const char *path, uint8_t *buf, size_t maxLen, size_t *len) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+
+	*len = fread(buf, 1, maxLen + 1, file);
+	bool ok = !ferror(file) && *len <= maxLen;
+	fclose(file);
+
+	return ok;
+}
+
+static void render_put(uint8_t *buf, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		buf[i] = value >> (8 * (size - 1 - i));
+	}
+}
+
+static uint32_t render_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (size_t j = 0; j < 8; j++) {
+			crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+		}
+	}
+
+	return ~crc;
+}
+
+static void render_png_chunk(FILE *file, const char *type, const uint8_t *data, size_t len) {
+	uint8_t header[8];
+	render_put(header, len, 4);
+	memcpy(&header[4], type, 4);
+
+	uint8_t crc[4];
+	render_put(crc, render_crc32(render_crc32(0, &header[4], 4), data, len), 4);
+
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(data, 1, len, file);
+	fwrite(crc, 1, sizeof(crc), file);
+}
+
+// One row per tick, one pixel per LED. The image data goes in stored
+// (uncompressed) deflate blocks, which keeps zlib out of the build.
+static bool render_write_png(const char *path, const struct RenderOutput *output) {
+	size_t rowLen = 1 + RENDER_FRAME_LEN;
+	size_t rawLen = rowLen * output->count;
+	size_t blocks = rawLen / RENDER_PNG_BLOCK_LEN + 1;
+
+	uint8_t *raw = malloc(rawLen);
+	uint8_t *zlib = malloc(2 + blocks * 5 + rawLen + 4);
+	if (raw == NULL || zlib == NULL) {
+		free(raw);
+		free(zlib);
+		return false;
+	}
+
+	for (uint32_t y = 0; y < output->count; y++) {
+		raw[y * rowLen] = 0;
+		memcpy(&raw[y * rowLen + 1], &output->frames[(size_t) y * RENDER_FRAME_LEN], RENDER_FRAME_LEN);
+	}
+
+	size_t len = 0;
+	zlib[len++] = 0x78;
+	zlib[len++] = 0x01;
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (size_t i = 0; i < rawLen; i++) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	for (size_t pos = 0; pos < rawLen; pos += RENDER_PNG_BLOCK_LEN) {
+		size_t blockLen = rawLen - pos < RENDER_PNG_BLOCK_LEN ? rawLen - pos : RENDER_PNG_BLOCK_LEN;
+
+		zlib[len++] = pos + blockLen == rawLen;
+		zlib[len++] = blockLen;
+		zlib[len++] = blockLen >> 8;
+		zlib[len++] = ~blockLen;
+		zlib[len++] = ~blockLen >> 8;
+		memcpy(&zlib[len], &raw[pos], blockLen);
+		len += blockLen;
+	}
+
+	render_put(&zlib[len], b << 16 | a, 4);
+	len += 4;
+
+	uint8_t ihdr[13] = { 0 };
+	render_put(&ihdr[0], STRIP_LED_COUNT, 4);
+	render_put(&ihdr[4], output->count, 4);
+	ihdr[8] = 8;
+	ihdr[9] = 2;
+
+	FILE *file = fopen(path, "wb");
+	if (file != NULL) {
+		fwrite("\x89PNG\r\n\x1A\n", 1, 8, file);
+		render_png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+		render_png_chunk(file, "IDAT", zlib, len);
+		render_png_chunk(file, "IEND", NULL, 0);
+	}
+
+	free(raw);
+	free(zlib);
+
+	return file != NULL && fclose(file) == 0;
+}
+
+// [magic "BLKF"][leds:u16][frames:u32][frames * leds * RGB], big-endian
+static bool render_write_frames(const char *path, const struct RenderOutput *output) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	uint8_t header[10];
+	memcpy(header, RENDER_FRAMES_MAGIC, 4);
+	render_put(&header[4], STRIP_LED_COUNT, 2);
+	render_put(&header[6], output->count, 4);
+
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(output->frames, RENDER_FRAME_LEN, output->count, file);
+
+	return fclose(file) == 0;
+}
+
+static bool render_has_suffix(const char *str, const char *suffix) {
+	size_t len = strlen(str);
+	size_t suffixLen = strlen(suffix);
+
+	return len >= suffixLen && strcmp(&str[len - suffixLen], suffix) == 0;
+}
+
+// program.bin -> program.golden
+static char *render_golden_path(const char *path) {
+	size_t len = strlen(path);
+	if (render_has_suffix(path, ".bin")) {
+		len -= 4;
+	}
+
+	char *golden = malloc(len + sizeof(".golden"));
+	if (golden != NULL) {
+		memcpy(golden, path, len);
+		strcpy(&golden[len], ".golden");
+	}
+
+	return golden;
+}
+
+// Goldens hold one hex frame hash per line, so a diff shows which ticks moved
+static bool render_write_golden(const char *path, const struct RenderOutput *output) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < output->count; i++) {
+		fprintf(file, "%08" PRIx32 "\n", output->hashes[i]);
+	}
+
+	return fclose(file) == 0;
+}
+
+static void render_check_golden(const char *path, const struct RenderOutput *output, char *result, size_t resultLen) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		snprintf(result, resultLen, "no golden");
+		return;
+	}
+
+	uint32_t count = 0;
+	uint32_t differing = 0;
+	uint32_t first = 0;
+	uint32_t hash;
+
+	while (fscanf(file, "%" SCNx32, &hash) == 1) {
+		if (count < output->count && hash != output->hashes[count]) {
+			if (differing++ == 0) {
+				first = count;
+			}
+		}
+
+		count++;
+	}
+
+	fclose(file);
+
+	if (count != output->count) {
+		snprintf(result, resultLen, "golden has %" PRIu32 " frames", count);
+	} else if (differing > 0) {
+		snprintf(result, resultLen, "golden differs from tick %" PRIu32 " (%" PRIu32 " frames)", first, differing);
+	} else {
+		snprintf(result, resultLen, "golden ok");
+	}
+}
+
+static bool render_program(const char *path, const struct RenderOptions *options) {
+	// Room for the end marker, should the file leave it out
+	static uint8_t bytecode[BC_MAX_LEN + 9];
+	memset(bytecode, 0xFF, sizeof(bytecode));
+
+	size_t len;
+	if (!render_read(path, bytecode, BC_MAX_LEN, &len)) {
+		printf("%s: can't read program\n", path);
+		return false;
+	}
+
+	struct RenderOutput output = {
+		.frames = options->output != NULL ? malloc((size_t) options->frames * RENDER_FRAME_LEN) : NULL,
+		.hashes = malloc(((size_t) options->frames + 1) * sizeof(uint32_t))
+	};
+
+	if (output.hashes == NULL || (options->output != NULL && output.frames == NULL)) {
+		printf("%s: not enough memory for %" PRIu32 " frames\n", path, options->frames);
+		free(output.frames);
+		free(output.hashes);
+		return false;
+	}
+
+	struct BytecodeRender render;
+	bool ok = bc_render(bytecode, options->frames, !options->interpret, &render_frame, &output, &render);
+
+	double seconds = render.renderUs > 0 ? render.renderUs / 1e6 : 1e-6;
+	printf("%s: %" PRIu32 " frames, %" PRIu64 " instrs, %.0f frames/s, %.1f Minstr/s, hash %08" PRIx32,
+		path,
+		render.frames,
+		render.instrs,
+		render.frames / seconds,
+		render.instrs / seconds / 1e6,
+		render_hash((const uint8_t *) output.hashes, output.count * sizeof(uint32_t)));
+
+	if (!ok) {
+		printf(", error: %s\n", render.error);
+		free(output.frames);
+		free(output.hashes);
+		return false;
+	}
+
+	char *golden = render_golden_path(path);
+	char result[128] = "";
+
+	if (golden == NULL) {
+		snprintf(result, sizeof(result), "out of memory");
+		ok = false;
+	} else if (options->update) {
+		ok = render_write_golden(golden, &output);
+		snprintf(result, sizeof(result), ok ? "golden written" : "can't write golden");
+	} else if (options->check) {
+		render_check_golden(golden, &output, result, sizeof(result));
+		ok = strcmp(result, "golden ok") == 0;
+	}
+
+	if (ok && options->output != NULL) {
+		ok = render_has_suffix(options->output, ".png") ?
+			render_write_png(options->output, &output) :
+			render_write_frames(options->output, &output);
+
+		if (!ok) {
+			snprintf(result, sizeof(result), "can't write %s", options->output);
+		}
+	}
+
+	printf("%s%s\n", result[0] != '\0' ? ", " : "", result);
+
+	free(golden);
+	free(output.frames);
+	free(output.hashes);
+
+	return ok;
+}
+
+// Renders each stock effect both ways, which have to agree frame for frame
+static bool render_effects(const struct RenderOptions *options) {
+	uint32_t *hashes[2];
+	hashes[0] = malloc(((size_t) options->frames + 1) * sizeof(uint32_t));
+	hashes[1] = malloc(((size_t) options->frames + 1) * sizeof(uint32_t));
+
+	if (hashes[0] == NULL || hashes[1] == NULL) {
+		printf("not enough memory for %" PRIu32 " frames\n", options->frames);
+		free(hashes[0]);
+		free(hashes[1]);
+		return false;
+	}
+
+	bool ok = true;
+
+	for (size_t i = 0; i < BC_EFFECT_COUNT; i++) {
+		const struct BytecodeEffect *effect = &gBytecodeEffects[i];
+		struct BytecodeRender render[2];
+		struct RenderOutput output[2];
+		bool rendered = true;
+
+		for (size_t native = 0; native < 2; native++) {
+			output[native] = (struct RenderOutput) { .hashes = hashes[native] };
+			rendered &= bc_render(effect->bytecode, options->frames, native, &render_frame, &output[native], &render[native]);
+		}
+
+		printf("%s: ", effect->name);
+
+		if (!rendered) {
+			printf("error: %s\n", render[0].error[0] != '\0' ? render[0].error : render[1].error);
+			ok = false;
+			continue;
+		}
+
+		uint32_t differing = 0;
+		uint32_t first = 0;
+
+		for (uint32_t frame = 0; frame < output[0].count; frame++) {
+			if (hashes[0][frame] != hashes[1][frame] && differing++ == 0) {
+				first = frame;
+			}
+		}
+
+		double interpretedUs = render[0].renderUs > 0 ? render[0].renderUs : 1;
+		double nativeUs = render[1].renderUs > 0 ? render[1].renderUs : 1;
+
+		printf("%" PRIu32 " frames, %.0f us/frame interpreted, %.0f us/frame native, %.1fx, ",
+			render[0].frames,
+			interpretedUs / render[0].frames,
+			nativeUs / render[1].frames,
+			interpretedUs / nativeUs);
+
+		if (render[0].instrs != render[1].instrs) {
+			printf("instrs differ (%" PRIu64 " vs %" PRIu64 ")\n", render[0].instrs, render[1].instrs);
+			ok = false;
+		} else if (differing > 0) {
+			printf("native differs from tick %" PRIu32 " (%" PRIu32 " frames)\n", first, differing);
+			ok = false;
+		} else {
+			printf("native ok\n");
+		}
+	}
+
+	free(hashes[0]);
+	free(hashes[1]);
+
+	return ok;
+}
+
+static int render_compare_names(const void *a, const void *b) {
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// Programs run in name order, so reports line up between runs
+static bool render_dir(const char *path, const struct RenderOptions *options) {
+	DIR *dir = opendir(path);
+	if (dir == NULL) {
+		printf("%s: can't open directory\n", path);
+		return false;
+	}
+
+	char **names = NULL;
+	size_t count = 0;
+	struct dirent *entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (!render_has_suffix(entry->d_name, ".bin")) {
+			continue;
+		}
+
+		char **grown = realloc(names, (count + 1) * sizeof(char *));
+		if (grown == NULL) {
+			break;
+		}
+
+		names = grown;
+		names[count] = malloc(strlen(path) + strlen(entry->d_name) + 2);
+		if (names[count] == NULL) {
+			break;
+		}
+
+		sprintf(names[count++], "%s/%s", path, entry->d_name);
+	}
+
+	closedir(dir);
+	qsort(names, count, sizeof(char *), &render_compare_names);
+
+	bool ok = true;
+	for (size_t i = 0; i < count; i++) {
+		ok &= render_program(names[i], options);
+		free(names[i]);
+	}
+
+	free(names);
+
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	struct RenderOptions options = {
+		.frames = RENDER_DEFAULT_FRAMES
+	};
+
+	const char *layoutPath = NULL;
+	bool effects = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:o:l:guie")) != -1) {
+		switch (opt) {
+			case 'n':
+				options.frames = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'o':
+				options.output = optarg;
+				break;
+
+			case 'l':
+				layoutPath = optarg;
+				break;
+
+			case 'g':
+				options.check = true;
+				break;
+
+			case 'u':
+				options.update = true;
+				break;
+
+			case 'i':
+				options.interpret = true;
+				break;
+
+			case 'e':
+				effects = true;
+				break;
+
+			default:
+				render_usage();
+				return 2;
+		}
+	}
+
+	if ((optind == argc) != effects || options.frames == 0 || (options.check && options.update)) {
+		render_usage();
+		return 2;
+	}
+
+	if (options.output != NULL && argc - optind > 1) {
+		fprintf(stderr, "render: -o takes a single program\n");
+		return 2;
+	}
+
+	layout_init();
+	bc_init();
+
+	if (layoutPath != NULL) {
+		static uint8_t layout[LAYOUT_DATA_LEN];
+
+		size_t len;
+		if (!render_read(layoutPath, layout, sizeof(layout), &len) || len != sizeof(layout)) {
+			fprintf(stderr, "render: %s isn't a %d byte layout\n", layoutPath, LAYOUT_DATA_LEN);
+			return 2;
+		}
+
+		layout_update(layout);
+	}
+
+	if (effects) {
+		return render_effects(&options) ? 0 : 1;
+	}
+
+	bool ok = true;
+
+	for (int i = optind; i < argc; i++) {
+		struct stat st;
+
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (options.output != NULL) {
+				fprintf(stderr, "render: -o takes a single program\n");
+				return 2;
+			}
+
+			ok &= render_dir(argv[i], &options);
+		} else {
+			ok &= render_program(argv[i], &options);
+		}
+	}
+
+	return ok ? 0 : 1;
+}
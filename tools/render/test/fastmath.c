@@ -0,0 +1,122 @@
+#include "bytecode.c"
+
+#include <stdlib.h>
+
+#define FASTMATH_SAMPLES 1000000
+#define FASTMATH_BENCH_CALLS 10000000
+#define FASTMATH_TRIG_RANGE 100.0
+#define FASTMATH_TAN_RANGE 100.0
+
+struct FastmathCheck {
+	const char *name;
+	double maxError;
+	double bound;
+	double at;
+};
+
+static double fastmath_uniform(double min, double max) {
+	return min + (max - min) * (rand() / (double) RAND_MAX);
+}
+
+// Errors are relative to double precision libm
+static void fastmath_sample(struct FastmathCheck *check, uint32_t sample, double error, double at) {
+	if (sample == 0 || !(error <= check->maxError)) {
+		check->maxError = error;
+		check->at = at;
+	}
+}
+
+static bool fastmath_report(const struct FastmathCheck *check) {
+	bool ok = check->maxError < check->bound;
+	printf("%s: max error %.3g at %.9g, bound %.3g, %s\n", check->name, check->maxError, check->at, check->bound, ok ? "ok" : "FAILED");
+
+	return ok;
+}
+
+static bool fastmath_accuracy(void) {
+	struct FastmathCheck sinCheck = { .name = "fsinr", .bound = 1e-4 };
+	struct FastmathCheck cosCheck = { .name = "fcosr", .bound = 1e-4 };
+	struct FastmathCheck tanCheck = { .name = "ftanr", .bound = 2e-4 };
+	struct FastmathCheck atan2Check = { .name = "fatan2r", .bound = 2e-5 };
+	struct FastmathCheck sqrtCheck = { .name = "fsqrtr", .bound = 1e-5 };
+
+	for (uint32_t i = 0; i < FASTMATH_SAMPLES; i++) {
+		float x = fastmath_uniform(-FASTMATH_TRIG_RANGE, FASTMATH_TRIG_RANGE);
+		fastmath_sample(&sinCheck, i, fabs(bc_fast_sin(x) - sin(x)), x);
+		fastmath_sample(&cosCheck, i, fabs(bc_fast_cos(x) - cos(x)), x);
+
+		// Scaled by the slope, see bc_op_ftanr
+		double t = tan(x);
+		if (fabs(t) < FASTMATH_TAN_RANGE) {
+			fastmath_sample(&tanCheck, i, fabs(bc_fast_sin(x) / bc_fast_cos(x) - t) / (1 + t * t), x);
+		}
+
+		float y = fastmath_uniform(-100, 100);
+		float z = fastmath_uniform(-100, 100);
+		fastmath_sample(&atan2Check, i, fabs(bc_fast_atan2(y, z) - atan2(y, z)), atan2(y, z));
+
+		// Log-uniform over the normal floats
+		float s = exp2(fastmath_uniform(-126, 127));
+		fastmath_sample(&sqrtCheck, i, fabs(bc_fast_sqrt(s) - sqrt(s)) / sqrt(s), s);
+	}
+
+	bool ok = true;
+	ok &= fastmath_report(&sinCheck);
+	ok &= fastmath_report(&cosCheck);
+	ok &= fastmath_report(&tanCheck);
+	ok &= fastmath_report(&atan2Check);
+	ok &= fastmath_report(&sqrtCheck);
+
+	// Edge cases the op docs promise
+	ok &= bc_fast_atan2(0, 0) == 0 && bc_fast_sqrt(0) == 0 && isnan(bc_fast_sqrt(-1));
+
+	return ok;
+}
+
+// Inputs come from a buffer so the calls can't be hoisted out of the loop
+static volatile float sFastmathSink;
+static float sFastmathInputs[0x400];
+
+#define FASTMATH_BENCH(name, expr) do { \
+	int64_t start = esp_timer_get_time(); \
+	float sum = 0; \
+	for (uint32_t i = 0; i < FASTMATH_BENCH_CALLS; i++) { \
+		float x = sFastmathInputs[i & 0x3FF]; \
+		sum += (expr); \
+	} \
+	sFastmathSink = sum; \
+	printf("%-8s %6.2f ns/call\n", name, (esp_timer_get_time() - start) * 1e3 / FASTMATH_BENCH_CALLS); \
+} while (0)
+
+static void fastmath_bench(void) {
+	for (size_t i = 0; i < 0x400; i++) {
+		sFastmathInputs[i] = fastmath_uniform(0.01, 10);
+	}
+
+	FASTMATH_BENCH("sinf", sinf(x));
+	FASTMATH_BENCH("fsinr", bc_fast_sin(x));
+	FASTMATH_BENCH("cosf", cosf(x));
+	FASTMATH_BENCH("fcosr", bc_fast_cos(x));
+	FASTMATH_BENCH("tanf", tanf(x));
+	FASTMATH_BENCH("ftanr", bc_fast_sin(x) / bc_fast_cos(x));
+	FASTMATH_BENCH("atan2f", atan2f(x, 3.0f));
+	FASTMATH_BENCH("fatan2r", bc_fast_atan2(x, 3.0f));
+	FASTMATH_BENCH("sqrtf", sqrtf(x));
+	FASTMATH_BENCH("fsqrtr", bc_fast_sqrt(x));
+}
+
+// Checks the fast math instructions against libm over their documented
+// domains, then times them against it. bytecode.c is built in so the static
+// helpers can be reached. Pass -b to run the benchmark.
+int main(int argc, char **argv) {
+	bc_init();
+	srand(1);
+
+	bool ok = fastmath_accuracy();
+
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		fastmath_bench();
+	}
+
+	return ok ? 0 : 1;
+}
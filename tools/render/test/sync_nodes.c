@@ -0,0 +1,269 @@
+#include "bytecode.c"
+#include "sync.c"
+
+#include <stdlib.h>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define SYNC_NODES_COUNT 4
+#define SYNC_NODES_MAX_FRAMES 256
+#define SYNC_NODES_BEACON_US 50000
+#define SYNC_NODES_UPDATE_US 500000
+#define SYNC_NODES_ACTIVATE_US 1000000
+#define SYNC_NODES_RUN_US 2000000
+#define SYNC_NODES_TOLERANCE_US 1000
+
+// Frames in real time, which all the nodes share underneath their skews
+struct SyncNodesFrame {
+	uint32_t hash;
+	uint32_t ticks;
+	int64_t us;
+};
+
+struct SyncNodesLog {
+	bool locked;
+	size_t count;
+	struct SyncNodesFrame frames[SYNC_NODES_MAX_FRAMES];
+};
+
+extern int64_t gHostClockSkewUs;
+
+static const int64_t sSyncNodesSkews[SYNC_NODES_COUNT] = { 2000000, -7000000, 123456, -40000 };
+
+static int sSyncNodesSocks[SYNC_NODES_COUNT];
+static struct sockaddr_in sSyncNodesAddrs[SYNC_NODES_COUNT];
+static struct SyncNodesLog *sSyncNodesLogs;
+static int64_t sSyncNodesStart;
+static int64_t sSyncNodesNextBeacon;
+
+static int64_t sync_nodes_real(void) {
+	return esp_timer_get_time() - gHostClockSkewUs;
+}
+
+// Sends a beacon to each follower when one is due, or takes in whatever
+// beacons arrived, like sync_lead and sync_follow
+static void sync_nodes_pump(size_t node) {
+	if (gSyncRole == SYNC_ROLE_LEADER) {
+		if (sync_nodes_real() < sSyncNodesNextBeacon) {
+			return;
+		}
+
+		taskENTER_CRITICAL(&sSyncLock);
+		struct SyncAnchor anchor = sLocalAnchor;
+		taskEXIT_CRITICAL(&sSyncLock);
+
+		uint8_t buf[SYNC_PACKET_LEN];
+		sync_encode(buf, sync_now(), &anchor);
+
+		for (size_t i = 1; i < SYNC_NODES_COUNT; i++) {
+			sendto(sSyncNodesSocks[0], buf, sizeof(buf), 0, (struct sockaddr *) &sSyncNodesAddrs[i], sizeof(sSyncNodesAddrs[i]));
+		}
+
+		sSyncNodesNextBeacon += SYNC_NODES_BEACON_US;
+		return;
+	}
+
+	uint8_t buf[SYNC_PACKET_LEN + 1];
+	ssize_t len;
+
+	while ((len = recv(sSyncNodesSocks[node], buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+		int64_t localUs = esp_timer_get_time();
+		int64_t leaderUs;
+		struct SyncAnchor anchor;
+
+		if (sync_decode(buf, len, &leaderUs, &anchor)) {
+			sync_sample(leaderUs, localUs, &anchor);
+		}
+	}
+}
+
+// Followers wake as soon as a beacon arrives, so it's timestamped on arrival
+static void sync_nodes_wait(size_t node, int64_t until) {
+	while (true) {
+		sync_nodes_pump(node);
+
+		int64_t now = sync_nodes_real();
+		if (now >= until) {
+			return;
+		}
+
+		int64_t wake = gSyncRole == SYNC_ROLE_LEADER && sSyncNodesNextBeacon < until ? sSyncNodesNextBeacon : until;
+		struct pollfd fd = { .fd = sSyncNodesSocks[node], .events = POLLIN };
+		poll(&fd, 1, wake > now ? (wake - now + 999) / 1000 : 0);
+	}
+}
+
+// The synced part of bc_task, with rendering but without the strip
+static void sync_nodes_run(size_t node) {
+	struct SyncNodesLog *log = &sSyncNodesLogs[node];
+	struct BytecodeVm *vm = &sVm;
+	bool updated = false;
+
+	gHostClockSkewUs = sSyncNodesSkews[node];
+	gSyncRole = node == 0 ? SYNC_ROLE_LEADER : SYNC_ROLE_FOLLOWER;
+	sSyncNodesNextBeacon = sSyncNodesStart;
+
+	layout_init();
+	bc_init();
+
+	while (sync_nodes_real() < sSyncNodesStart + SYNC_NODES_RUN_US && log->count < SYNC_NODES_MAX_FRAMES) {
+		// Each node is given the same start time in the leader's clock
+		if (!updated && sync_nodes_real() >= sSyncNodesStart + SYNC_NODES_UPDATE_US) {
+			log->locked = sync_locked();
+			bc_update(gBytecodeEffects[1].bytecode, false, sSyncNodesStart + SYNC_NODES_ACTIVATE_US + sSyncNodesSkews[0]);
+			updated = true;
+		}
+
+		vm->cancel = false;
+		bc_activate();
+		bc_schedule();
+
+		switch (vm->bytecode[1]) {
+			case BC_MODE_PER_LED:
+				bc_render_leds(vm);
+				break;
+
+			case BC_MODE_PER_TICK:
+				bc_execute(vm);
+				break;
+		}
+
+		bc_anchor_period();
+
+		// When the frame goes out, from shared time back to real time
+		int64_t us = bc_deadline() - sOffset - gHostClockSkewUs;
+
+		log->frames[log->count++] = (struct SyncNodesFrame) {
+			.hash = sAnchor.hash,
+			.ticks = vm->ticks,
+			.us = us
+		};
+
+		sync_nodes_wait(node, us);
+		vm->ticks++;
+	}
+}
+
+static const struct SyncNodesFrame *sync_nodes_find(const struct SyncNodesLog *log, uint32_t hash, uint32_t ticks) {
+	for (size_t i = 0; i < log->count; i++) {
+		if (log->frames[i].hash == hash && log->frames[i].ticks == ticks) {
+			return &log->frames[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Once locked, a follower shows each of the leader's frames when the leader
+// does, and switches to the scheduled program on the same frame
+static bool sync_nodes_check(size_t node) {
+	const struct SyncNodesLog *leader = &sSyncNodesLogs[0];
+	const struct SyncNodesLog *log = &sSyncNodesLogs[node];
+
+	uint32_t hash = bc_hash(gBytecodeEffects[1].bytecode, bc_len(gBytecodeEffects[1].bytecode));
+	int64_t activateUs = sSyncNodesStart + SYNC_NODES_ACTIVATE_US;
+
+	const struct SyncNodesFrame *first = NULL;
+	int64_t maxError = 0;
+	size_t checked = 0;
+	size_t missing = 0;
+
+	for (size_t i = 0; i < log->count; i++) {
+		const struct SyncNodesFrame *frame = &log->frames[i];
+
+		if (frame->hash == hash && first == NULL) {
+			first = frame;
+		}
+
+		if (frame->us < sSyncNodesStart + SYNC_NODES_UPDATE_US) {
+			continue;
+		}
+
+		const struct SyncNodesFrame *match = sync_nodes_find(leader, frame->hash, frame->ticks);
+		if (match == NULL) {
+			missing += frame->us < leader->frames[leader->count - 1].us;
+			continue;
+		}
+
+		int64_t error = llabs(frame->us - match->us);
+		maxError = error > maxError ? error : maxError;
+		checked++;
+	}
+
+	bool activated = first != NULL && first->ticks == 0 && llabs(first->us - activateUs) < SYNC_NODES_TOLERANCE_US;
+	bool ok = log->locked && activated && checked > 0 && missing == 0 && maxError < SYNC_NODES_TOLERANCE_US;
+
+	printf("node %zu: skew %+" PRId64 " us, %s, %zu frames within %" PRId64 " us of the leader, %zu missing, ",
+		node,
+		sSyncNodesSkews[node],
+		log->locked ? "locked" : "not locked",
+		checked,
+		maxError,
+		missing);
+
+	if (first == NULL) {
+		printf("never activated, FAILED\n");
+	} else {
+		printf("activated on tick %" PRIu32 " %+" PRId64 " us, %s\n", first->ticks, first->us - activateUs, ok ? "ok" : "FAILED");
+	}
+
+	return ok;
+}
+
+// Runs a leader and followers with skewed clocks as separate processes,
+// talking over loopback UDP, and checks that they show the same frames at
+// the same time. bytecode.c and sync.c are built in so their static state
+// can be driven without tasks.
+int main(void) {
+	sSyncNodesLogs = mmap(NULL, SYNC_NODES_COUNT * sizeof(struct SyncNodesLog), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sSyncNodesLogs == MAP_FAILED) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < SYNC_NODES_COUNT; i++) {
+		sSyncNodesAddrs[i] = (struct sockaddr_in) {
+			.sin_family = AF_INET,
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+		};
+
+		socklen_t len = sizeof(sSyncNodesAddrs[i]);
+		sSyncNodesSocks[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+		if (sSyncNodesSocks[i] < 0 ||
+			bind(sSyncNodesSocks[i], (struct sockaddr *) &sSyncNodesAddrs[i], len) != 0 ||
+			getsockname(sSyncNodesSocks[i], (struct sockaddr *) &sSyncNodesAddrs[i], &len) != 0) {
+			printf("can't open loopback sockets\n");
+			return 1;
+		}
+	}
+
+	// Leaves the followers time to start before the first beacon
+	sSyncNodesStart = sync_nodes_real() + SYNC_NODES_BEACON_US;
+
+	pid_t pids[SYNC_NODES_COUNT];
+	for (size_t i = 1; i < SYNC_NODES_COUNT; i++) {
+		pids[i] = fork();
+
+		if (pids[i] == 0) {
+			sync_nodes_run(i);
+			_exit(0);
+		}
+	}
+
+	sync_nodes_run(0);
+
+	bool ok = true;
+	for (size_t i = 1; i < SYNC_NODES_COUNT; i++) {
+		int status;
+		ok &= pids[i] > 0 && waitpid(pids[i], &status, 0) == pids[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	for (size_t i = 0; i < SYNC_NODES_COUNT; i++) {
+		ok &= sync_nodes_check(i);
+	}
+
+	return ok ? 0 : 1;
+}